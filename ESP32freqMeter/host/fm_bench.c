@@ -0,0 +1,1019 @@
+/* ESP32 Frequency Meter - accuracy and latency benchmark on the host simulator
+
+   Sweeps the input from 1 Hz to 40 MHz and runs a few signal scenarios at
+   1 MHz, driving the measurement core exactly like app_main does.
+
+   Per point it reports:
+     error    measured frequency against the true mean frequency of the
+              counted interval (from the simulator phase)
+     rate     readings per simulated second
+     latency  requested gate end -> result available to the application,
+              including the wait for the loop's next 1 ms tick
+     dead     share of the run not covered by any gate (lost input edges)
+     core     host CPU time spent in the core per reading
+     gate     mean gate length (changes with -r / -a autoranging)
+
+   Reciprocal capture timing: the capture ISR reads the capture register,
+   which every later edge overwrites, and the timebase, and dates the edge
+   from the difference. Rows run 10 ms reciprocal gates with the capture
+   counter misaligned by a few ticks and with the timebase read before the
+   register, so that edges land between the two reads.
+
+   Then it drains the record ring with a second, slow reader and checks that
+   the records it skips are exactly the ones counted as dropped, and runs 1 to
+   8 channels at 40 MHz on a common gate to show the PCNT ISR rate and the
+   per gate cost. "isr load" assumes ISR_BOARD_US per interrupt on the board
+   (entry, dispatch and exit of an IRAM ISR at 240 MHz); the host ns columns
+   are measured.
+
+   Last, the output formats: the app's text line against fm_stream.h binary
+   frames, in bytes per reading, host encode / decode time and the readings
+   per second a UART can carry. -s writes the binary stream to a file for
+   fm_decode.
+
+   Then the statistics stage (fm_stats.h) on 100 s of 10 ms gates of a 1 MHz
+   input with white frequency noise and a small drift: its incremental mean,
+   standard deviation, drift and Allan deviation (reciprocal mode) against the same figures
+   computed offline from all readings, and its cost per reading. White
+   frequency noise gives an Allan deviation falling as 1 / sqrt(tau), the
+   drift lifts it again at the longest taus. A 237 Hz input on 20 ms
+   reciprocal gates, which end up to a period late, checks that gates of
+   varying length still add up to one Allan run.
+
+   Then the tachometer (fm_tach.h) on a simulated 1000 PPR encoder from
+   10 Hz to 500 kHz on A, backwards, with an off-nominal duty and phase, and
+   through a reversal: position against the simulator's exact count, speed
+   against the true mean speed of each 100 ms read, duty and phase, and the
+   interrupts per second it takes against one per edge. The edge captures
+   are overwritten by later edges before their ISR reads them, so "sets"
+   counts the reads that kept an edge set: all of them while an A half
+   period outlasts the ISR latency, fewer at 487 kHz or with 5 us latency.
+
+   Then the signal generator (fm_gen.h): the solver's divider, resolution
+   and frequency error against the float log2 setup ledcInit used before,
+   and a closed loop self-test with the LEDC output driving the meter input:
+   a log sweep retuned in place, each step against the first reading whose
+   gate opened after it.
+
+   Last, the loop time of app_main in gated mode with no LCD, with the 16 x 2
+   I2C LCD written inline before the gate is re-armed as it used to be, and
+   with the display task (fm_display.h). LCD_BYTE_US is the assumed bus time
+   per character or cursor command; the display task's own bus time runs on
+   the other core and is only counted in bytes.
+
+   Then the instrumentation (fm_trace.h) as the board would dump it after a
+   few scenarios, and its cost per recorded value. Latencies follow the
+   simulated timer and ISR delays; ISR and loop spans are host CPU time.
+
+   Then gated mode with the software gate (control output set by the gate
+   timer callback) against the LEDC hardware gate (cfg.hw_gate) on a fixed
+   40 MHz input: the time actually counted, edges / 2f, against the gate
+   length the reading uses. One input edge is 12.5 ns, so a gate exact to the
+   tick stays within that. The software gate runs 20 to 30 us long, but the
+   reading uses its measured span, which stays within a tick as well.
+   The last row delays the interrupts by 60 to 120 us against 114 us of dead
+   time, at 1 MHz so that the PCNT overflow interrupt keeps up: the late
+   readings and the ones after them are dropped rather than mixed with the
+   next gate.
+
+   Usage: fm_bench [-m gated|continuous|reciprocal|auto] [-n gates per point] [-t sample time us]
+                   [-r target ppb] [-a target mHz] [-s stream file]
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "fm_core.h"
+#include "fm_display.h"
+#include "fm_gen.h"
+#include "fm_sim.h"
+#include "fm_stats.h"
+#include "fm_stream.h"
+#include "fm_tach.h"
+#include "fm_trace.h"
+
+#define TICKS_PER_US          (FM_TIMEBASE_HZ / 1000000)
+#define RTOS_TICK             (FM_TIMEBASE_HZ / 1000)                     // FreeRTOS tick, 1 ms
+#define ISR_BOARD_US          2.0                                         // Assumed PCNT ISR cost on the ESP32, us
+#define LCD_BYTE_US           1300                                        // LiquidCrystal_I2C at 100 kHz: 6 transfers + 2 enable pulses
+
+typedef struct {
+  double err_abs_mean;                                                    // Hz
+  double err_abs_max;                                                     // Hz
+  double err_rms_ppm;
+  double rate;                                                            // Readings per second
+  double latency_us;                                                      // Mean
+  double latency_max_us;
+  double dead_pct;                                                        // Time not covered by a gate
+  double core_ns;                                                         // Host CPU per reading
+  double gate_ms;                                                         // Mean gate length
+} bench_point_t;
+
+static int      gates       = 5;                                          // Readings per point
+static uint32_t sample_time = 1000000;                                    // Gate time, us
+static fm_mode_t mode       = FM_MODE_AUTO;
+static fm_range_t range     = { 0, 0, 0, 0 };                             // Autorange targets, off by default
+static const char *stream_path = NULL;                                    // -s: binary stream output
+static const char *mode_name[] = { "gated", "continuous", "reciprocal", "auto" };
+
+//----------------------------------------------------------------------------------
+static uint64_t host_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//----------------------------------------------------------------------------------
+static void loop_sleep(void)                                              // vTaskDelay(1) in app_main: up to the next tick
+{
+  fm_sim_run(RTOS_TICK - fm_sim_now() % RTOS_TICK);
+}
+
+//----------------------------------------------------------------------------------
+static void bench_config(fm_config_t *cfg, uint32_t us, fm_mode_t m)      // Unit 0, GPIOs as on the board
+{
+  static const int gpios[FM_MAX_CHANNELS - 1] = { 26, 27, 14, 12, 13, 15, 4 };
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->unit          = 0;
+  cfg->sig_gpio      = 34;
+  cfg->ctrl_gpio     = 35;
+  cfg->out_ctrl_gpio = 32;
+  cfg->sample_time   = us;
+  cfg->mode          = m;
+  memcpy(cfg->ch_gpio, gpios, sizeof(gpios));
+}
+
+//----------------------------------------------------------------------------------
+static void run_point(const fm_sim_config_t *simcfg, const fm_sim_signal_t *sig, bench_point_t *bp)
+{
+  fm_config_t cfg;
+  fm_result_t res;
+  double sum_abs = 0, max_abs = 0, sum_ppm2 = 0, sum_lat = 0, max_lat = 0, sum_gate = 0;
+  uint64_t core = 0, first = 0, last = 0, covered = 0, open = 0;
+  int n = 0;
+  int settle = range.resolution_ppb || range.resolution_mhz ? 1 : 0;
+
+  bench_config(&cfg, sample_time, mode);
+  cfg.range = range;
+  fm_sim_reset(simcfg);
+  fm_sim_set_signal(0, sig);
+  fm_meter_init(&cfg);
+  fm_meter_start();
+
+  while (n < gates) {                                                     // app_main: drain the ring, sleep when it was empty
+    bool idle = true;
+    uint64_t t0 = host_ns();
+    while (n < gates && fm_meter_poll(&res)) {
+      core += host_ns() - t0;                                             // Only the polls that return a reading
+      idle = false;
+      if (settle > 0) {                                                   // Autorange: first gate is sample_time
+        settle--;
+        t0 = host_ns();
+        continue;
+      }
+
+      double span = (double)(res.gate_end - res.gate_start) / FM_TIMEBASE_HZ;
+      double truth = (fm_sim_phase_at(0, res.gate_end) - fm_sim_phase_at(0, res.gate_start)) / span;
+      double err = res.frequency - truth;
+      double lat = (double)(int64_t)(res.ready - res.gate_due) / TICKS_PER_US;
+
+      if (n == 0) {
+        first = res.ready;
+        open = res.gate_start;
+      }
+      last = res.ready;
+      covered += res.gate_end - res.gate_start;
+      sum_abs += fabs(err);
+      if (fabs(err) > max_abs) max_abs = fabs(err);
+      if (truth > 0) sum_ppm2 += (err / truth * 1e6) * (err / truth * 1e6);
+      sum_lat += lat;
+      if (lat > max_lat) max_lat = lat;
+      sum_gate += span;
+      n++;
+      t0 = host_ns();
+    }
+    if (idle) {
+      loop_sleep();
+      continue;
+    }
+    t0 = host_ns();
+    fm_meter_start();
+    core += host_ns() - t0;
+  }
+
+  bp->err_abs_mean   = sum_abs / n;
+  bp->err_abs_max    = max_abs;
+  bp->err_rms_ppm    = sqrt(sum_ppm2 / n);
+  bp->rate           = n > 1 ? (n - 1) * (double)FM_TIMEBASE_HZ / (double)(last - first) : 0;
+  bp->latency_us     = sum_lat / n;
+  bp->latency_max_us = max_lat;
+  bp->dead_pct       = 100.0 * (1.0 - (double)covered / (double)(res.gate_end - open));
+  bp->core_ns        = (double)core / n;
+  bp->gate_ms        = sum_gate * 1000 / n;
+}
+
+//----------------------------------------------------------------------------------
+static void run_consumers(const fm_sim_config_t *simcfg, uint32_t period_ms) // Slow reader next to fm_meter_poll
+{
+  static fm_result_t seen[1024];                                          // fm_meter_poll records by seq
+  fm_config_t cfg;
+  fm_sim_signal_t sig = { 1e6, 0, 0, 0, 0 };
+  fm_reader_t slow;
+  fm_result_t res;
+  uint32_t polled = 0, read = 0, bad = 0, poll_next = 0, slow_next = 0;
+
+  bench_config(&cfg, 10000, FM_MODE_CONTINUOUS);
+  fm_sim_reset(simcfg);
+  fm_sim_set_signal(0, &sig);
+  fm_meter_init(&cfg);
+  fm_meter_reader_init(&slow);
+  fm_meter_start();
+
+  for (uint32_t ms = 1; ms <= 10000; ms++) {                              // 10 s of 10 ms gates
+    fm_sim_run(FM_TIMEBASE_HZ / 1000);
+    while (fm_meter_poll(&res)) {
+      if (res.seq != poll_next++ || res.overflow) bad++;                  // Fast reader never loses a record
+      seen[res.seq % 1024] = res;
+      polled++;
+    }
+    if (ms % period_ms) continue;
+    uint32_t before = slow.dropped;
+    while (fm_meter_read(&slow, &res)) {
+      uint32_t gap = res.seq - slow_next;
+      if (gap != slow.dropped - before || res.overflow != (gap != 0)) bad++; // Skips are all counted
+      if (res.edges != seen[res.seq % 1024].edges) bad++;                 // Same record the fast reader got
+      slow_next = res.seq + 1;
+      before = slow.dropped;
+      read++;
+    }
+  }
+  printf("%-14u %9u %9u %9u %9u\n", period_ms, polled, read, slow.dropped, bad);
+}
+
+//----------------------------------------------------------------------------------
+static void run_channels(const fm_sim_config_t *simcfg, int n)            // n inputs near 40 MHz, 100 ms common gate
+{
+  fm_config_t cfg;
+  fm_result_t res;
+  fm_sim_stats_t st;
+  double max_ppm = 0;
+  uint32_t records = 0;
+
+  bench_config(&cfg, 100000, FM_MODE_CONTINUOUS);
+  cfg.channels = n;
+  fm_sim_reset(simcfg);
+  for (int i = 0; i < n; i++) {
+    fm_sim_signal_t sig = { 40e6 * (1.0 - 1e-4 * i), 0, 0, 0, 0 };
+    fm_sim_set_signal(i, &sig);                                           // Unit i = channel i
+  }
+  fm_meter_init(&cfg);
+  fm_meter_start();
+
+  for (int ms = 0; ms < 2000; ms++) {
+    fm_sim_run(FM_TIMEBASE_HZ / 1000);
+    while (fm_meter_poll(&res)) {
+      double span = (double)(res.gate_end - res.gate_start) / FM_TIMEBASE_HZ;
+      double truth = (fm_sim_phase_at(res.channel, res.gate_end) - fm_sim_phase_at(res.channel, res.gate_start)) / span;
+      double ppm = fabs(res.frequency - truth) / truth * 1e6;
+      if (ppm > max_ppm) max_ppm = ppm;
+      records++;
+    }
+  }
+  fm_sim_get_stats(&st);
+  double secs = 2.0;
+  double isr_rate = st.isr_calls / secs;
+  printf("%-9d %9.0f %9.2f %9.0f %10.2f %9.0f %9.0f %11.3f %8u\n", n, isr_rate,
+         st.isr_calls ? (double)st.isr_units / st.isr_calls : 0,
+         st.isr_calls ? (double)st.isr_host_ns / st.isr_calls : 0,
+         isr_rate * ISR_BOARD_US * 1e-4,                                  // % of one core
+         st.timer_calls ? (double)st.timer_host_ns / st.timer_calls : 0,
+         st.timer_calls ? (double)st.timer_host_ns / st.timer_calls / n : 0, max_ppm, records);
+}
+
+//----------------------------------------------------------------------------------
+static size_t text_reading(char *buf, const fm_result_t *r, int channels) // The app's console line
+{
+  char digits[24];
+  char *p = buf;
+  unsigned long val = (unsigned long)r->frequency;
+  int n = snprintf(digits, sizeof(digits), "%lu", val);
+  if (channels > 1) p += sprintf(p, "CH%d ", r->channel);
+  p += sprintf(p, "Frequency: ");
+  for (int i = 0; i < n; i++) {                                           // Thousands separators, as ltos()
+    *p++ = digits[i];
+    if ((n - 1 - i) % 3 == 0 && i != n - 1) *p++ = ',';
+  }
+  p += sprintf(p, " Hz \n");
+  return (size_t)(p - buf);
+}
+
+//----------------------------------------------------------------------------------
+static void run_formats(const fm_sim_config_t *simcfg)                    // Text vs binary output of the same readings
+{
+  enum { N = 4000, CHANNELS = 4 };
+  static fm_result_t recs[N];
+  static fm_result_t back[N];
+  static uint8_t stream[N / FM_STREAM_BATCH * FM_STREAM_FRAME_MAX + FM_STREAM_FRAME_MAX];
+  fm_config_t cfg;
+  int n = 0;
+
+  bench_config(&cfg, 10000, FM_MODE_CONTINUOUS);                          // 4 inputs, 10 ms gates
+  cfg.channels = CHANNELS;
+  fm_sim_reset(simcfg);
+  for (int i = 0; i < CHANNELS; i++) {
+    fm_sim_signal_t sig = { 1e3 * (1 + 1000 * i) + 17, 0, 0, 0, 0 };
+    fm_sim_set_signal(i, &sig);
+  }
+  fm_meter_init(&cfg);
+  fm_meter_start();
+  while (n < N) {
+    fm_sim_run(FM_TIMEBASE_HZ / 1000);
+    while (n < N && fm_meter_poll(&recs[n])) n++;
+  }
+
+  char line[64];
+  size_t text_bytes = 0;
+  uint64_t t0 = host_ns();
+  for (int i = 0; i < N; i++) text_bytes += text_reading(line, &recs[i], CHANNELS);
+  double text_ns = (double)(host_ns() - t0) / N;
+
+  fm_stream_t st;
+  size_t bin_bytes = 0;
+  fm_stream_init(&st);
+  t0 = host_ns();
+  for (int i = 0; i < N; i++) {
+    if (fm_stream_add(&st, &recs[i])) {
+      size_t len = fm_stream_finish(&st);
+      memcpy(stream + bin_bytes, st.frame, len);                          // The app writes the frame to the UART here
+      bin_bytes += len;
+    }
+  }
+  size_t len = fm_stream_finish(&st);
+  memcpy(stream + bin_bytes, st.frame, len);
+  bin_bytes += len;
+  double enc_ns = (double)(host_ns() - t0) / N;
+
+  int m = 0, bad = 0;
+  t0 = host_ns();
+  for (size_t pos = 0; pos < bin_bytes; ) {
+    size_t flen = fm_stream_frame_len(stream + pos);
+    int cnt = fm_stream_decode(stream + pos, flen, back + m, NULL, N - m);
+    if (cnt < 0) {
+      bad++;
+      break;
+    }
+    m += cnt;
+    pos += flen;
+  }
+  double dec_ns = (double)(host_ns() - t0) / N;
+  for (int i = 0; i < m; i++)
+    if (back[i].seq != recs[i].seq || back[i].edges != recs[i].edges || back[i].gate_ticks != recs[i].gate_ticks ||
+        back[i].gate_end != recs[i].gate_end || back[i].channel != recs[i].channel) bad++;
+  if (m != N) bad++;
+
+  if (stream_path) {
+    FILE *f = fopen(stream_path, "wb");
+    if (f) {
+      fwrite(stream, 1, bin_bytes, f);
+      fclose(f);
+    }
+  }
+
+  double text_per = (double)text_bytes / N;
+  double bin_per = (double)bin_bytes / N;
+  printf("%-9s %9.2f %9.0f %9s %12.0f %12.0f %9s\n", "text", text_per, text_ns, "-",
+         11520.0 / text_per, 92160.0 / text_per, "-");
+  printf("%-9s %9.2f %9.0f %9.0f %12.0f %12.0f %9d\n", "binary", bin_per, enc_ns, dec_ns,
+         11520.0 / bin_per, 92160.0 / bin_per, bad);
+}
+
+//----------------------------------------------------------------------------------
+static double oadev(const double *dx, int n, int m, double tau, uint32_t *terms) // Offline overlapping ADEV, phase steps dx[]
+{
+  double sum = 0;
+  uint32_t cnt = 0;
+  double x0 = 0, xm = 0, x2m = 0;                                         // Phase at i, i + m, i + 2m
+  for (int i = 0; i < m; i++) xm += dx[i];
+  for (int i = 0; i < 2 * m; i++) x2m += dx[i];
+  for (int i = 0; i + 2 * m <= n; i++) {
+    double d = x2m - 2 * xm + x0;
+    sum += d * d;
+    cnt++;
+    if (i + 2 * m == n) break;
+    x0 += dx[i];
+    xm += dx[i + m];
+    x2m += dx[i + 2 * m];
+  }
+  *terms = cnt;
+  return cnt ? sqrt(sum / (2.0 * tau * tau * cnt)) : 0;
+}
+
+//----------------------------------------------------------------------------------
+static void phase_steps(const fm_result_t *recs, int n, double *dx)       // y times the actual gate, seconds
+{
+  for (int i = 0; i < n; i++)
+    dx[i] = (recs[i].frequency - recs[0].frequency) / recs[0].frequency * recs[i].gate_ticks / FM_TIMEBASE_HZ;
+}
+
+//----------------------------------------------------------------------------------
+static void run_stats(const fm_sim_config_t *simcfg)                      // Streaming statistics against offline figures
+{
+  enum { N = 10000 };
+  static fm_result_t recs[N];
+  static double dx[N];
+  static fm_stats_t st;
+  fm_stats_report_t rep;
+  fm_config_t cfg;
+  int n = 0;
+
+  bench_config(&cfg, 10000, FM_MODE_RECIPROCAL);                          // 1.25 ppb resolution, the noise dominates
+  fm_sim_reset(simcfg);
+  fm_sim_signal_t sig = { 1e6, 0.01, 10, 0, 0 };                          // 10 ppm per 1 ms segment, 0.01 Hz/s
+  fm_sim_set_signal(0, &sig);
+  fm_meter_init(&cfg);
+  fm_meter_start();
+  while (n < N) {
+    fm_sim_run(FM_TIMEBASE_HZ / 1000);
+    while (n < N && fm_meter_poll(&recs[n])) n++;
+  }
+
+  fm_stats_reset(&st);
+  uint64_t t0 = host_ns();
+  for (int i = 0; i < N; i++) fm_stats_add(&st, &recs[i]);
+  double add_ns = (double)(host_ns() - t0) / N;
+  fm_stats_report(&st, &rep);
+
+  double mean = 0, var = 0, mt = 0, ctf = 0, vt = 0;                      // Two pass reference
+  for (int i = 0; i < N; i++) {
+    mean += recs[i].frequency / N;
+    mt += (double)recs[i].gate_end / FM_TIMEBASE_HZ / N;
+  }
+  for (int i = 0; i < N; i++) {
+    double df = recs[i].frequency - mean;
+    double dt = (double)recs[i].gate_end / FM_TIMEBASE_HZ - mt;
+    var += df * df;
+    ctf += dt * df;
+    vt += dt * dt;
+  }
+  phase_steps(recs, N, dx);
+  printf("%-10s %16s %16s\n", "", "stream", "offline");
+  printf("%-10s %16.6f %16.6f\n", "mean Hz", rep.mean, mean);
+  printf("%-10s %16.6f %16.6f\n", "sd Hz", rep.stddev, sqrt(var / (N - 1)));
+  printf("%-10s %16.6f %16.6f\n", "drift Hz/s", rep.drift, ctf / vt);
+  printf("%-10s %16.1f %16s   (%.0f ns per reading, %u bytes)\n\n", "n", (double)rep.n, "", add_ns,
+         (unsigned)sizeof(st));
+
+  printf("%-10s %12s %12s %9s %9s %12s\n", "tau s", "adev", "offline", "terms", "offline", "white fm");
+  double tau0 = (double)recs[0].gate_nominal / FM_TIMEBASE_HZ;
+  double seg = (double)simcfg->segment / FM_TIMEBASE_HZ;
+  for (int i = 0; i < rep.taus; i++) {
+    int m = (int)(rep.tau[i] / tau0 + 0.5);
+    uint32_t terms;
+    double ref = oadev(dx, N, m, rep.tau[i], &terms);
+    printf("%-10.2f %12.3e %12.3e %9u %9u %12.3e\n", rep.tau[i], rep.adev[i], ref, rep.terms[i], terms,
+           sig.noise_ppm * 1e-6 * sqrt(seg / rep.tau[i]));
+  }
+}
+
+//----------------------------------------------------------------------------------
+static void run_stats_slow(const fm_sim_config_t *simcfg)                 // Reciprocal gates that vary by a period
+{
+  enum { N = 2000 };
+  static fm_result_t recs[N];
+  static double dx[N];
+  static fm_stats_t st;
+  fm_stats_report_t rep;
+  fm_config_t cfg;
+  int n = 0;
+
+  bench_config(&cfg, 20000, FM_MODE_RECIPROCAL);
+  fm_sim_reset(simcfg);
+  fm_sim_signal_t sig = { 237, 0, 10, 0, 0 };
+  fm_sim_set_signal(0, &sig);
+  fm_meter_init(&cfg);
+  fm_meter_start();
+  while (n < N) {
+    fm_sim_run(FM_TIMEBASE_HZ / 100);
+    while (n < N && fm_meter_poll(&recs[n])) n++;
+  }
+  fm_stats_reset(&st);
+  uint64_t lo = recs[0].gate_ticks, hi = lo;
+  for (int i = 0; i < N; i++) {
+    fm_stats_add(&st, &recs[i]);
+    if (recs[i].gate_ticks < lo) lo = recs[i].gate_ticks;
+    if (recs[i].gate_ticks > hi) hi = recs[i].gate_ticks;
+  }
+  fm_stats_report(&st, &rep);
+  phase_steps(recs, N, dx);
+  printf("%-10s %12s %12s %9s %9s   gates %.1f to %.1f ms\n", "tau s", "adev", "offline", "terms", "offline",
+         lo * 1e3 / FM_TIMEBASE_HZ, hi * 1e3 / FM_TIMEBASE_HZ);
+  for (int i = 0; i < rep.taus && i < 4; i++) {
+    uint32_t terms;
+    double ref = oadev(dx, N, (int)(rep.tau[i] / rep.tau[0] + 0.5), rep.tau[i], &terms);
+    printf("%-10.2f %12.3e %12.3e %9u %9u\n", rep.tau[i], rep.adev[i], ref, rep.terms[i], terms);
+  }
+}
+
+//----------------------------------------------------------------------------------
+static void run_tach(const fm_sim_config_t *simcfg, const char *name, const fm_sim_signal_t *sig, double duty,
+                     double phase_deg)
+{
+  enum { UNIT = 7, PPR = 1000, READS = 20 };
+  fm_tach_config_t cfg = { UNIT, 18, 19, PPR };
+  fm_tach_result_t res;
+  fm_sim_stats_t st;
+  double err_rpm = 0, err_ppm = 0, duty_err = 0, phase_err = 0, last_rpm = 0;
+  int64_t pos_err = 0;
+  int periods = 0, sets = 0;
+
+  fm_sim_reset(simcfg);
+  fm_sim_set_signal(UNIT, sig);
+  fm_sim_set_encoder(UNIT, duty, phase_deg);
+  fm_tach_init(&cfg);
+  for (int i = 0; i < READS; i++) {
+    fm_sim_run(FM_TIMEBASE_HZ / 10);
+    fm_tach_read(&res);
+    int64_t pe = res.position - fm_sim_position(UNIT);
+    if (llabs(pe) > llabs(pos_err)) pos_err = pe;
+    double span = (double)res.window / FM_TIMEBASE_HZ;
+    double truth = (fm_sim_phase_at(UNIT, res.time) - fm_sim_phase_at(UNIT, res.time - res.window)) / span / PPR * 60;
+    double e = i ? fabs(res.rpm - truth) : 0;                             // First read: no edge set yet
+    if (e > err_rpm) err_rpm = e;
+    if (fabs(truth) > 0.1 && e / fabs(truth) * 1e6 > err_ppm) err_ppm = e / fabs(truth) * 1e6;
+    if (res.from_period) periods++;
+    if (res.edges_valid) sets++;
+    if (res.edges_valid && sig->drift_hz_s == 0) {
+      double want = sig->freq_hz > 0 ? phase_deg : 360 - phase_deg;       // Backwards B rises 360 - phase after A
+      if (fabs(res.duty - duty) > duty_err) duty_err = fabs(res.duty - duty);
+      if (fabs(res.phase - want) > phase_err) phase_err = fabs(res.phase - want);
+    }
+    last_rpm = res.rpm;
+  }
+  fm_sim_get_stats(&st);
+  double secs = READS / 10.0;
+  char duty_s[16] = "-", phase_s[16] = "-";                               // No edge set kept: not measured
+  if (sets) {
+    snprintf(duty_s, sizeof(duty_s), "%.4f", duty_err);
+    snprintf(phase_s, sizeof(phase_s), "%.3f", phase_err);
+  }
+  printf("%-14s %12.2f %10.3f %10.1f %8lld %7d %5d %9s %9s %9.0f %9.0f %11.0f\n", name, last_rpm, err_rpm, err_ppm,
+         (long long)pos_err, periods, sets, duty_s, phase_s, st.isr_calls / secs, st.edge_calls / secs,
+         4 * fabs(sig->freq_hz) + 2 * fabs(sig->drift_hz_s) * secs);
+}
+
+//----------------------------------------------------------------------------------
+static void run_gen_solve(double freq_hz)                                 // Solver against the float log2 setup
+{
+  fm_gen_setting_t s;
+  uint64_t mhz = (uint64_t)llround(freq_hz * 1000);
+  enum { REPS = 1000 };
+
+  uint64_t t0 = host_ns();
+  for (int i = 0; i < REPS; i++) fm_gen_solve(mhz, 500, &s);
+  double ns = (double)(host_ns() - t0) / REPS;
+
+  uint32_t old_res = (uint32_t)((log((double)(80000000 / (uint32_t)freq_hz)) / log(2)) / 2); // ledcInit before
+  if (old_res < 1) old_res = 1;
+  uint64_t steps = (uint64_t)(uint32_t)freq_hz << old_res;                // ledc_timer_config, IDF v4
+  uint64_t old_div = ((FM_GEN_CLK_HZ << 8) + steps / 2) / steps;
+  char old[16] = "fails";
+  if (old_div >= FM_GEN_DIV_MIN && old_div <= FM_GEN_DIV_MAX) {
+    fm_gen_setting_t o = { (uint32_t)old_div, (uint8_t)old_res, 0, 0, 0, 0 };
+    snprintf(old, sizeof(old), "%.3f", (fm_gen_hz(&o) - freq_hz) / freq_hz * 1e6);
+  }
+  printf("%-14.3f %10.4f %5u %18.6f %10.3f %10s %9.0f\n", freq_hz, s.div / 256.0, s.res, fm_gen_hz(&s),
+         (fm_gen_hz(&s) - mhz / 1000.0) / (mhz / 1000.0) * 1e6, old, ns);
+}
+
+//----------------------------------------------------------------------------------
+static void run_gen_selftest(const fm_sim_config_t *simcfg)               // LEDC output into the meter, log sweep
+{
+  enum { STEPS = 13, DWELL_MS = 500 };
+  fm_config_t cfg;
+  fm_result_t res;
+  fm_gen_sweep_t sw;
+  double worst = 0;
+  int index = -1, checked = 0;
+  uint64_t step_time = 0;
+
+  bench_config(&cfg, 100000, FM_MODE_AUTO);                               // 100 ms first gate, then autorange 1 ppm
+  cfg.range.resolution_ppb = 1000;
+  fm_sim_reset(simcfg);
+  fm_sim_connect_ledc(0);
+  fm_gen_init(25);
+  fm_gen_sweep_log(&sw, 10000, 10000000000ULL, STEPS, 500, DWELL_MS * 1000);
+  fm_gen_sweep_start(&sw);
+  fm_meter_init(&cfg);
+  fm_meter_start();
+
+  while (sw.index >= 0) {
+    if (sw.index != index) {                                              // Stepped: wait for a gate opened after it
+      index = sw.index;
+      step_time = fm_sim_now();
+      checked = 0;
+    }
+    bool idle = true;
+    while (fm_meter_poll(&res)) {
+      idle = false;
+      if (!checked && res.gate_start >= step_time) {
+        const fm_gen_setting_t *s = &sw.step[index];
+        double actual = fm_gen_hz(s);
+        double ppm = (res.frequency - actual) / actual * 1e6;
+        if (fabs(ppm) > worst) worst = fabs(ppm);
+        printf("%-14.3f %18.6f %18.6f %10.3f %9.1f %9.1f\n", s->freq_mhz / 1000.0, actual, res.frequency, ppm,
+               (double)(res.ready - step_time) / TICKS_PER_US / 1000, (double)res.gate_ticks / TICKS_PER_US / 1000);
+        checked = 1;
+      }
+    }
+    if (!idle) fm_meter_start();
+    fm_gen_sweep_poll(&sw);
+    if (idle) loop_sleep();
+  }
+  printf("max error %.3f ppm\n", worst);
+}
+
+//----------------------------------------------------------------------------------
+static void bench_lcd_render(const fm_result_t *res, fm_display_frame_t frame, void *arg) // As lcdRender in the app
+{
+  char buf[32];
+  (void)arg;
+  fm_display_text(frame, 0, 0, "Frequency Meter");
+  snprintf(buf, sizeof(buf), "%.0f Hz", res->frequency);
+  fm_display_text(frame, 1, 1, buf);
+}
+
+static void bench_lcd_write(int col, int row, const char *text, int len, void *arg) // Cursor command + characters
+{
+  (void)col;
+  (void)row;
+  (void)text;
+  *(uint64_t *)arg += 1 + len;
+}
+
+//----------------------------------------------------------------------------------
+static void run_display(const fm_sim_config_t *simcfg, const char *name, uint32_t gate_us, int lcd) // 0 off, 1 inline, 2 task
+{
+  enum { SECONDS = 10 };
+  fm_config_t cfg;
+  fm_result_t res;
+  uint64_t bytes = 0, pub_ns = 0, loop = 0, loop_max = 0, covered = 0, next_refresh = 0;
+  fm_sim_signal_t sig = { 1e6, 0, 1, 0, 0 };                              // 1 ppm noise: the last digits move
+  fm_display_config_t dcfg = { 16, 2, 200000, bench_lcd_render, bench_lcd_write, &bytes };
+  int n = 0;
+
+  bench_config(&cfg, gate_us, FM_MODE_GATED);
+  fm_sim_reset(simcfg);
+  fm_sim_set_signal(0, &sig);
+  fm_display_init(&dcfg);
+  fm_meter_init(&cfg);
+  fm_meter_start();
+  uint64_t end = (uint64_t)SECONDS * FM_TIMEBASE_HZ;
+
+  while (fm_sim_now() < end) {
+    if (lcd == 2 && fm_sim_now() >= next_refresh) {                       // Display task, other core
+      fm_display_refresh();
+      next_refresh = fm_sim_now() + (uint64_t)dcfg.interval_us * TICKS_PER_US;
+    }
+    bool idle = true;
+    while (fm_meter_poll(&res)) {
+      idle = false;
+      covered += res.gate_end - res.gate_start;
+      n++;
+      if (lcd == 1) {                                                     // Banner + value line, every reading
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "%.0f", res.frequency);
+        uint64_t b = 1 + 15 + 1 + len + 17;
+        bytes += b;
+        fm_sim_run(b * LCD_BYTE_US * TICKS_PER_US);
+      } else if (lcd == 2) {
+        uint64_t t0 = host_ns();
+        fm_display_publish(&res);
+        pub_ns += host_ns() - t0;
+      }
+    }
+    if (idle) {
+      loop_sleep();
+      continue;
+    }
+    uint64_t l = fm_sim_now() - res.ready;                                // Gate end to the next gate
+    loop += l;
+    if (l > loop_max) loop_max = l;
+    fm_meter_start();
+  }
+  fm_display_stats_t ds;
+  fm_display_get_stats(&ds);
+  double secs = (double)fm_sim_now() / FM_TIMEBASE_HZ;
+  printf("%-14s %9.2f %9.2f %9.2f %8.2f %9.0f %9.1f %9.0f\n", name, n / secs, (double)loop / n / TICKS_PER_US / 1000,
+         (double)loop_max / TICKS_PER_US / 1000, 100.0 * (1.0 - (double)covered / fm_sim_now()), bytes / secs,
+         lcd == 2 ? ds.refreshes / secs : lcd ? n / secs : 0, lcd == 2 ? (double)pub_ns / n : 0);
+}
+
+//----------------------------------------------------------------------------------
+static void run_trace(const fm_sim_config_t *simcfg, const char *name, const fm_sim_signal_t *sig, fm_mode_t m,
+                      uint32_t gate_us, uint32_t jitter_us)               // fm_trace figures after 5 s
+{
+  enum { SECONDS = 5 };
+  static char buf[4096];
+  fm_config_t cfg;
+  fm_result_t res;
+  fm_sim_config_t c = *simcfg;
+  c.timer_jitter = jitter_us * TICKS_PER_US;
+
+  bench_config(&cfg, gate_us, m);
+  fm_sim_reset(&c);
+  fm_sim_set_signal(0, sig);
+  fm_meter_init(&cfg);
+  fm_trace_reset();
+  fm_meter_start();
+  uint64_t end = (uint64_t)SECONDS * FM_TIMEBASE_HZ;
+  while (fm_sim_now() < end) {
+    FM_TRACE_LOOP();
+    bool idle = true;
+    while (fm_meter_poll(&res)) idle = false;
+    if (idle) loop_sleep();
+    else fm_meter_start();
+  }
+  fm_trace_format(buf, sizeof(buf), '\n');
+  printf("%s\n", name);
+  for (char *line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) printf("  %s\n", line);
+}
+
+//----------------------------------------------------------------------------------
+static void run_trace_cost(void)                                          // Host ns per recorded value
+{
+  enum { N = 1000000 };
+  uint64_t t0 = host_ns();
+  for (uint32_t i = 0; i < N; i++) FM_TRACE_HIST(FM_TRACE_LOOP, i * 2654435761u >> 12);
+  uint64_t t1 = host_ns();
+  for (uint32_t i = 0; i < N; i++) FM_TRACE_SPAN(FM_TRACE_LOOP, FM_TRACE_STAMP());
+  uint64_t t2 = host_ns();
+  fm_trace_reset();
+  printf("FM_TRACE %d: histogram value %.1f ns, span with two stamps %.1f ns\n", FM_TRACE, (double)(t1 - t0) / N,
+         (double)(t2 - t1) / N);
+}
+
+//----------------------------------------------------------------------------------
+static void run_hwgate(const fm_sim_config_t *simcfg, const char *name, double freq, uint32_t gate_us, bool hw,
+                       uint32_t isr_us)                                   // Gate width error, 20 readings or 100 gates
+{
+  enum { READINGS = 20 };
+  fm_config_t cfg;
+  fm_result_t res;
+  fm_sim_config_t c = *simcfg;
+  fm_sim_signal_t sig = { freq, 0, 0, 0, 0 };
+  double sum_w = 0, max_w = 0, max_ppm = 0;
+  uint64_t gated = 0, first = 0, first_ready = 0;
+  int n = 0;
+  if (isr_us) {                                                           // Interrupts isr_us to 2 * isr_us late
+    c.isr_latency = isr_us * TICKS_PER_US;
+    c.isr_jitter  = isr_us * TICKS_PER_US;
+  }
+
+  bench_config(&cfg, gate_us, FM_MODE_GATED);
+  cfg.hw_gate = hw;
+  fm_sim_reset(&c);
+  fm_sim_set_signal(0, &sig);
+  fm_meter_init(&cfg);
+  fm_meter_start();
+  uint64_t end = (uint64_t)100 * gate_us * TICKS_PER_US;
+  while (n < READINGS && fm_sim_now() < end) {
+    bool idle = true;
+    while (n < READINGS && fm_meter_poll(&res)) {
+      idle = false;
+      double w = fabs((double)res.edges / (2.0 * freq) - (double)res.gate_ticks / FM_TIMEBASE_HZ) * 1e9;
+      double ppm = fabs(res.frequency - freq) / freq * 1e6;
+      if (n == 0) {
+        first = res.gate_start;
+        first_ready = res.ready;
+      }
+      sum_w += w;
+      if (w > max_w) max_w = w;
+      if (ppm > max_ppm) max_ppm = ppm;
+      gated += res.gate_ticks;
+      n++;
+    }
+    if (idle) loop_sleep();
+    else fm_meter_start();                                                // Hardware gate: already running
+  }
+  if (n < 2) {
+    printf("%-24s %9d readings\n", name, n);
+    return;
+  }
+  fm_sim_stats_t st;
+  fm_sim_get_stats(&st);
+  printf("%-24s %9.2f %12.1f %12.1f %11.3f %8.3f %9llu\n", name,
+         (n - 1) * (double)FM_TIMEBASE_HZ / (double)(res.ready - first_ready), sum_w / n, max_w, max_ppm,
+         100.0 * (1.0 - (double)gated / (double)(res.gate_end - first)),
+         (unsigned long long)(hw ? st.gate_calls : st.timer_calls));
+}
+
+//----------------------------------------------------------------------------------
+static void print_header(const char *first)
+{
+  printf("%-14s %12s %12s %12s %9s %10s %10s %8s %9s %9s\n", first,
+         "err mean Hz", "err max Hz", "err rms ppm", "rate /s", "lat us", "lat max us", "dead %", "core ns",
+         "gate ms");
+}
+
+static void print_point(const char *label, const bench_point_t *bp)
+{
+  printf("%-14s %12.4g %12.4g %12.4g %9.3f %10.1f %10.1f %8.4f %9.0f %9.1f\n", label, bp->err_abs_mean,
+         bp->err_abs_max, bp->err_rms_ppm, bp->rate, bp->latency_us, bp->latency_max_us, bp->dead_pct,
+         bp->core_ns, bp->gate_ms);
+}
+
+//----------------------------------------------------------------------------------
+static void run_capture(const fm_sim_config_t *simcfg, const char *name, double freq, int32_t align,
+                        uint32_t cap_read, uint32_t now_read)             // Reciprocal, 10 ms gates, 20 readings
+{
+  fm_sim_config_t c = *simcfg;
+  fm_sim_signal_t sig = { freq, 0, 0, 0, 0 };
+  fm_mode_t m = mode;
+  uint32_t us = sample_time;
+  int n = gates;
+  fm_range_t r = range;
+  bench_point_t bp;
+  c.cap_align = align;
+  c.cap_read  = cap_read;
+  c.now_read  = now_read;
+  mode = FM_MODE_RECIPROCAL;
+  sample_time = 10000;
+  gates = 20;
+  memset(&range, 0, sizeof(range));
+  run_point(&c, &sig, &bp);
+  print_point(name, &bp);
+  mode = m;
+  sample_time = us;
+  gates = n;
+  range = r;
+}
+
+//----------------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+  int opt;
+  while ((opt = getopt(argc, argv, "m:n:t:r:a:s:")) != -1) {
+    switch (opt) {
+      case 'm':
+        for (int m = FM_MODE_GATED; m <= FM_MODE_AUTO; m++)
+          if (strcmp(optarg, mode_name[m]) == 0) mode = (fm_mode_t)m;
+        break;
+      case 'n': gates = atoi(optarg); break;
+      case 't': sample_time = (uint32_t)strtoul(optarg, NULL, 10); break;
+      case 'r': range.resolution_ppb = (uint32_t)strtoul(optarg, NULL, 10); break;
+      case 'a': range.resolution_mhz = (uint32_t)strtoul(optarg, NULL, 10); break;
+      case 's': stream_path = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-m gated|continuous|reciprocal|auto] [-n gates] [-t sample_time_us] [-r ppb] [-a mHz] [-s stream_file]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (gates < 1) gates = 1;
+  if (sample_time < 1000) sample_time = 1000;
+
+  fm_sim_config_t simcfg;
+  fm_sim_default_config(&simcfg);
+  bench_point_t bp;
+  char label[32];
+
+  if (range.resolution_ppb || range.resolution_mhz)
+    printf("Frequency sweep, %s mode, %d gates per point, autorange %u ppb %u mHz\n", mode_name[mode], gates,
+           range.resolution_ppb, range.resolution_mhz);
+  else
+    printf("Frequency sweep, %s mode, %d gates of %u us per point\n", mode_name[mode], gates, sample_time);
+  print_header("input Hz");
+  static const double steps[] = { 1, 2, 5 };
+  for (double decade = 1; decade <= 10000000; decade *= 10) {
+    for (int i = 0; i < 3 && decade * steps[i] < 40000000; i++) {
+      fm_sim_signal_t sig = { decade * steps[i], 0, 0, 0, 0 };
+      run_point(&simcfg, &sig, &bp);
+      snprintf(label, sizeof(label), "%.0f", sig.freq_hz);
+      print_point(label, &bp);
+    }
+  }
+  fm_sim_signal_t top = { 40000000, 0, 0, 0, 0 };
+  run_point(&simcfg, &top, &bp);
+  print_point("40000000", &bp);
+
+  printf("\nScenarios at 1 MHz\n");
+  print_header("scenario");
+  static const struct {
+    const char     *name;
+    fm_sim_signal_t sig;
+    uint32_t        jitter_us;
+  } scen[] = {
+    { "fixed",       { 1e6, 0,    0,  0,   0   }, 10  },
+    { "drift 10/s",  { 1e6, 10.0, 0,  0,   0   }, 10  },
+    { "noise 10ppm", { 1e6, 0,    10, 0,   0   }, 10  },
+    { "burst .3/.2", { 1e6, 0,    0,  0.3, 0.2 }, 10  },
+    { "jitter 500",  { 1e6, 0,    0,  0,   0   }, 500 },
+  };
+  for (unsigned i = 0; i < sizeof(scen) / sizeof(scen[0]); i++) {
+    fm_sim_config_t c = simcfg;
+    c.timer_jitter = scen[i].jitter_us * TICKS_PER_US;
+    run_point(&c, &scen[i].sig, &bp);
+    print_point(scen[i].name, &bp);
+  }
+
+  printf("\nCapture timing, reciprocal, 10 ms gates, 20 readings, 1 us ISR latency\n");
+  print_header("capture");
+  run_capture(&simcfg, "1M",             1e6,     0, 0, 4);
+  run_capture(&simcfg, "19M",            19.3e6,  0, 0, 4);
+  run_capture(&simcfg, "19M align +2",   19.3e6,  2, 0, 4);
+  run_capture(&simcfg, "19M align -2",   19.3e6, -2, 0, 4);
+  run_capture(&simcfg, "1M now first",   1e6,     0, 8, 0);
+  run_capture(&simcfg, "19M now first",  19.3e6,  0, 8, 0);
+  run_capture(&simcfg, "19M now 1st +2", 19.3e6,  2, 8, 0);
+
+  printf("\nRecord ring, %d slots, 10 ms gates for 10 s, second reader draining every N ms\n", FM_RING_SIZE);
+  printf("%-14s %9s %9s %9s %9s\n", "reader ms", "polled", "read", "dropped", "bad");
+  static const uint32_t periods[] = { 100, 300, 1000 };
+  for (unsigned i = 0; i < sizeof(periods) / sizeof(periods[0]); i++) run_consumers(&simcfg, periods[i]);
+
+  printf("\nChannels at 40 MHz, 100 ms common gate, 2 s\n");
+  printf("%-9s %9s %9s %9s %10s %9s %9s %11s %8s\n", "channels", "isr /s", "units/isr", "isr ns",
+         "isr load %", "gate ns", "ns/chan", "err max ppm", "records");
+  static const int nchan[] = { 1, 2, 4, 8 };
+  for (unsigned i = 0; i < sizeof(nchan) / sizeof(nchan[0]); i++) run_channels(&simcfg, nchan[i]);
+
+  printf("\nOutput formats, 4 channels, 10 ms gates, 4000 readings\n");
+  printf("%-9s %9s %9s %9s %12s %12s %9s\n", "format", "bytes/rd", "enc ns", "dec ns", "rd/s 115200",
+         "rd/s 921600", "bad");
+  run_formats(&simcfg);
+
+  printf("\nStatistics, 1 MHz reciprocal, 10 ppm white frequency noise, 0.01 Hz/s drift, 10 ms gates, 100 s\n");
+  run_stats(&simcfg);
+  printf("\nStatistics, 237 Hz reciprocal, 10 ppm white frequency noise, 20 ms gates, 2000 readings\n");
+  run_stats_slow(&simcfg);
+
+  printf("\nTachometer, 1000 PPR encoder, x4 decode, read every 100 ms for 2 s\n");
+  printf("%-14s %12s %10s %10s %8s %7s %5s %9s %9s %9s %9s %11s\n", "A input", "rpm", "err rpm", "err ppm",
+         "pos err", "period", "sets", "duty err", "phase err", "pcnt /s", "edge /s", "per edge /s");
+  static const struct {
+    const char     *name;
+    fm_sim_signal_t sig;
+    double          duty;
+    double          phase;
+    uint32_t        isr_latency;                                          // Ticks, 0 = default 1 us
+  } enc[] = {
+    { "10.3 Hz",      { 10.3,    0,       0, 0, 0 }, 0.5, 90, 0 },
+    { "1.23 kHz",     { 1234.5,  0,       0, 0, 0 }, 0.5, 90, 0 },
+    { "98.8 kHz",     { 98765,   0,       0, 0, 0 }, 0.5, 90, 0 },
+    { "247 kHz",      { 246913,  0,       0, 0, 0 }, 0.5, 90, 0 },
+    { "487 kHz",      { 487321,  0,       0, 0, 0 }, 0.5, 90, 0 },
+    { "98.8k isr 5us",{ 98765,   0,       0, 0, 0 }, 0.5, 90, 400 },
+    { "-98.8 kHz",    { -98765,  0,       0, 0, 0 }, 0.5, 90, 0 },
+    { "1.23k .4/60",  { 1234.5,  0,       0, 0, 0 }, 0.4, 60, 0 },
+    { "50k reverse",  { 5e4,     -5e4,    0, 0, 0 }, 0.5, 90, 0 },
+  };
+  for (unsigned i = 0; i < sizeof(enc) / sizeof(enc[0]); i++) {
+    fm_sim_config_t tachcfg = simcfg;
+    if (enc[i].isr_latency) tachcfg.isr_latency = enc[i].isr_latency;
+    run_tach(&tachcfg, enc[i].name, &enc[i].sig, enc[i].duty, enc[i].phase);
+  }
+
+  printf("\nGenerator settings, 50%% duty, error against the request\n");
+  printf("%-14s %10s %5s %18s %10s %10s %9s\n", "request Hz", "divider", "bits", "actual Hz", "err ppm",
+         "log2 ppm", "solve ns");
+  static const double gen_hz[] = { 1, 10, 123.456, 1000, 12345, 50000, 100000, 333333, 1000000, 1234567,
+                                   3000000, 7000000, 10000000, 13333333, 20000000, 26700000, 40000000 };
+  for (unsigned i = 0; i < sizeof(gen_hz) / sizeof(gen_hz[0]); i++) run_gen_solve(gen_hz[i]);
+
+  printf("\nSelf-test, LEDC output on the meter input, log sweep 10 Hz - 10 MHz, 500 ms per step, autorange 1 ppm\n");
+  printf("%-14s %18s %18s %10s %9s %9s\n", "request Hz", "actual Hz", "read Hz", "err ppm", "after ms", "gate ms");
+  run_gen_selftest(&simcfg);
+
+  printf("\nDisplay, gated mode, 1 MHz input, 16 x 2 I2C LCD at %d us per byte, 10 s\n", LCD_BYTE_US);
+  printf("%-14s %9s %9s %9s %8s %9s %9s %9s\n", "lcd", "rate /s", "loop ms", "loop max", "dead %", "bytes/s",
+         "frames/s", "pub ns");
+  run_display(&simcfg, "off 100ms", 100000, 0);
+  run_display(&simcfg, "inline 100ms", 100000, 1);
+  run_display(&simcfg, "task 100ms", 100000, 2);
+  run_display(&simcfg, "off 20ms", 20000, 0);
+  run_display(&simcfg, "inline 20ms", 20000, 1);
+  run_display(&simcfg, "task 20ms", 20000, 2);
+
+  printf("\nInstrumentation, 5 s per scenario, ns (ovf_gate: overflows per reading)\n");
+  fm_sim_signal_t khz = { 1000, 0, 0, 0, 0 }, mhz = { 1e6, 0, 0, 0, 0 }, top40 = { 40e6, 0, 0, 0, 0 };
+  run_trace(&simcfg, "continuous 1 MHz, 10 ms gates", &mhz, FM_MODE_CONTINUOUS, 10000, 10);
+  run_trace(&simcfg, "continuous 1 MHz, 10 ms gates, timer jitter 500 us", &mhz, FM_MODE_CONTINUOUS, 10000, 500);
+  run_trace(&simcfg, "reciprocal 1 kHz, 10 ms gates", &khz, FM_MODE_RECIPROCAL, 10000, 10);
+  run_trace(&simcfg, "gated 40 MHz, 100 ms gates", &top40, FM_MODE_GATED, 100000, 10);
+  run_trace_cost();
+
+  printf("\nGate timing, gated mode, 40 MHz input (last row 1 MHz), 20 readings\n");
+  printf("%-24s %9s %12s %12s %11s %8s %9s\n", "gate", "rate /s", "width err ns", "width max ns",
+         "err max ppm", "dead %", "gate irqs");
+  run_hwgate(&simcfg, "software 10 ms", 40e6, 10000, false, 0);
+  run_hwgate(&simcfg, "hardware 10 ms", 40e6, 10000, true, 0);
+  run_hwgate(&simcfg, "software 100 ms", 40e6, 100000, false, 0);
+  run_hwgate(&simcfg, "hardware 100 ms", 40e6, 100000, true, 0);
+  run_hwgate(&simcfg, "software 1 s", 40e6, 1000000, false, 0);
+  run_hwgate(&simcfg, "hardware 1 s", 40e6, 1000000, true, 0);
+  run_hwgate(&simcfg, "hardware 10 ms, late isr", 1e6, 10000, true, 60); // 1 MHz: overflows every 10 ms
+  return 0;
+}
@@ -0,0 +1,221 @@
+/* ESP32 Frequency Meter - binary stream decoder / logger
+
+   Reads the fm_stream.h frames sent by the meter in binary output mode from a
+   file, a serial port / pty, or stdin, checks each frame's CRC and writes the
+   readings as CSV or as a columnar file. Bytes that are not part of a valid
+   frame (text output, noise, a frame cut by a reset) are skipped.
+
+   CSV columns: seq, channel, method, status, gate_end_s, gate_s, edges, frequency_hz
+
+   Columnar file: row groups of up to COL_GROUP readings, each
+     char[4] "FMCG", uint32 n, then the columns one after the other:
+     uint32 seq[n], uint8 channel[n], uint8 status[n], uint64 gate_end[n] (ticks),
+     uint64 gate_ticks[n], uint64 edges[n], double frequency_hz[n]
+   all little endian.
+
+   Usage: fm_decode [-o csv|col] [-b baud] [input|-] [output]
+
+   -b sets a serial input to 9600, 57600, 115200, 230400, 460800 or 921600
+   baud. Another rate or output format is a usage error.
+
+   A summary (frames, readings, CRC errors, skipped bytes, sequence gaps and
+   restarts) goes to stderr at the end of the input. A sequence number below
+   the expected one (device reset, a file replayed) restarts the count
+   instead of counting as a gap.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "fm_stream.h"
+
+#define COL_GROUP             4096                                        // Readings per columnar row group
+
+typedef struct {
+  uint64_t frames;
+  uint64_t records;
+  uint64_t crc_errors;
+  uint64_t skipped;                                                       // Bytes outside valid frames
+  uint64_t gaps;                                                          // Readings missing from the sequence
+  uint64_t restarts;                                                      // Sequence went backwards
+} decode_stats_t;
+
+static const char *method_name[] = { "gated", "continuous", "reciprocal", "auto" };
+
+static struct {                                                           // Columnar row group being filled
+  uint32_t n;
+  uint32_t seq[COL_GROUP];
+  uint8_t  channel[COL_GROUP];
+  uint8_t  status[COL_GROUP];
+  uint64_t gate_end[COL_GROUP];
+  uint64_t gate_ticks[COL_GROUP];
+  uint64_t edges[COL_GROUP];
+  double   frequency[COL_GROUP];
+} col;
+
+//----------------------------------------------------------------------------------
+static speed_t baud_code(long baud)
+{
+  switch (baud) {
+    case 9600:    return B9600;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+    case 460800:  return B460800;
+    case 921600:  return B921600;
+    default:      return 0;
+  }
+}
+
+//----------------------------------------------------------------------------------
+static int open_input(const char *path, long baud)                        // File, tty / pty (set raw) or stdin
+{
+  if (strcmp(path, "-") == 0) return STDIN_FILENO;
+  int fd = open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0 || !isatty(fd)) return fd;
+
+  struct termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    if (baud_code(baud)) {
+      cfsetispeed(&tio, baud_code(baud));
+      cfsetospeed(&tio, baud_code(baud));
+    }
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+//----------------------------------------------------------------------------------
+static void col_flush(FILE *out)
+{
+  if (col.n == 0) return;
+  fwrite("FMCG", 1, 4, out);
+  fwrite(&col.n, sizeof(col.n), 1, out);                                  // Host is little endian
+  fwrite(col.seq, sizeof(col.seq[0]), col.n, out);
+  fwrite(col.channel, sizeof(col.channel[0]), col.n, out);
+  fwrite(col.status, sizeof(col.status[0]), col.n, out);
+  fwrite(col.gate_end, sizeof(col.gate_end[0]), col.n, out);
+  fwrite(col.gate_ticks, sizeof(col.gate_ticks[0]), col.n, out);
+  fwrite(col.edges, sizeof(col.edges[0]), col.n, out);
+  fwrite(col.frequency, sizeof(col.frequency[0]), col.n, out);
+  col.n = 0;
+}
+
+//----------------------------------------------------------------------------------
+static void emit(FILE *out, bool csv, const fm_result_t *r, uint8_t status)
+{
+  if (csv) {
+    fprintf(out, "%u,%u,%s,0x%02x,%.9f,%.9f,%llu,%.6f\n", r->seq, r->channel, method_name[r->method & 3],
+            status, (double)r->gate_end / FM_TIMEBASE_HZ, (double)r->gate_ticks / FM_TIMEBASE_HZ,
+            (unsigned long long)r->edges, r->frequency);
+    return;
+  }
+  uint32_t i = col.n++;
+  col.seq[i]        = r->seq;
+  col.channel[i]    = r->channel;
+  col.status[i]     = status;
+  col.gate_end[i]   = r->gate_end;
+  col.gate_ticks[i] = r->gate_ticks;
+  col.edges[i]      = r->edges;
+  col.frequency[i]  = r->frequency;
+  if (col.n == COL_GROUP) col_flush(out);
+}
+
+//----------------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+  bool csv = true, usage = false;
+  long baud = 0;
+  char *end;
+  int opt;
+  while ((opt = getopt(argc, argv, "o:b:")) != -1) {
+    switch (opt) {
+      case 'o':
+        if (strcmp(optarg, "csv") == 0) csv = true;
+        else if (strcmp(optarg, "col") == 0) csv = false;
+        else usage = true;
+        break;
+      case 'b':
+        baud = strtol(optarg, &end, 10);
+        if (*end || !baud_code(baud)) usage = true;                       // termios takes the standard rates only
+        break;
+      default: usage = true; break;
+    }
+  }
+  if (usage || argc - optind > 2) {
+    fprintf(stderr, "usage: %s [-o csv|col] [-b 9600|57600|115200|230400|460800|921600] [input|-] [output]\n",
+            argv[0]);
+    return 1;
+  }
+  const char *in_path = optind < argc ? argv[optind] : "-";
+  int fd = open_input(in_path, baud);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", in_path, strerror(errno));
+    return 1;
+  }
+  FILE *out = stdout;
+  if (optind + 1 < argc && !(out = fopen(argv[optind + 1], csv ? "w" : "wb"))) {
+    fprintf(stderr, "%s: %s\n", argv[optind + 1], strerror(errno));
+    return 1;
+  }
+  if (csv) fprintf(out, "seq,channel,method,status,gate_end_s,gate_s,edges,frequency_hz\n");
+
+  static uint8_t buf[8192];
+  size_t have = 0;
+  decode_stats_t st = { 0, 0, 0, 0, 0, 0 };
+  uint32_t next_seq = 0;                                                  // Expected sequence number
+  bool seen = false;
+  fm_result_t rec[FM_STREAM_BATCH];
+  uint8_t status[FM_STREAM_BATCH];
+
+  for (;;) {
+    ssize_t n = read(fd, buf + have, sizeof(buf) - have);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    have += (size_t)n;
+
+    size_t pos = 0;
+    while (have - pos >= 4) {
+      size_t len = fm_stream_frame_len(buf + pos);
+      if (len == 0) {                                                     // Not a frame start
+        pos++;
+        st.skipped++;
+        continue;
+      }
+      if (have - pos < len) break;                                        // Wait for the rest
+      int cnt = fm_stream_decode(buf + pos, len, rec, status, FM_STREAM_BATCH);
+      if (cnt < 0) {                                                      // CRC error: resync one byte on
+        st.crc_errors++;
+        pos++;
+        st.skipped++;
+        continue;
+      }
+      for (int i = 0; i < cnt; i++) {
+        int32_t jump = (int32_t)(rec[i].seq - next_seq);                  // Signed: wraps at 2^32 like seq
+        if (seen && jump > 0) st.gaps += (uint64_t)jump;
+        else if (seen && jump < 0) st.restarts++;                         // Resync on the new numbering
+        seen = true;
+        next_seq = rec[i].seq + 1;
+        emit(out, csv, &rec[i], status[i]);
+      }
+      st.frames++;
+      st.records += (uint64_t)cnt;
+      pos += len;
+    }
+    memmove(buf, buf + pos, have - pos);
+    have -= pos;
+  }
+  if (!csv) col_flush(out);
+  if (out != stdout) fclose(out);
+
+  fprintf(stderr, "frames %llu, readings %llu, crc errors %llu, skipped bytes %llu, sequence gaps %llu, "
+          "restarts %llu\n", (unsigned long long)st.frames, (unsigned long long)st.records,
+          (unsigned long long)st.crc_errors, (unsigned long long)st.skipped, (unsigned long long)st.gaps,
+          (unsigned long long)st.restarts);
+  return 0;
+}
@@ -0,0 +1,817 @@
+/* ESP32 Frequency Meter - host simulator implementing fm_hal.h
+
+   Each input is a phase accumulator whose frequency is held constant over a
+   segment (cfg.segment ticks) and recomputed at segment boundaries from the
+   drift, noise and burst settings. Edge counts are floor(2 * phase), so the
+   counters see exactly the edges a real square wave would produce.
+
+   A quadrature unit counts the A and B transitions of an encoder whose A
+   rises at integer phase, falls at phase + duty, and whose B is A delayed by
+   phase_b cycles: forwards the count is the sum of floor(phase - offset) over
+   the four transition offsets, and the same expression counts down when the
+   phase runs backwards, like the x4 decoder on the board.
+
+   The hardware gate drives the counting control level from its own
+   schedule, high for gate_high ticks every gate_period ticks, and raises the
+   gate interrupt after each fall.
+
+   Events, in order of processing at equal times: counter limit reached,
+   segment boundary, capture edge, encoder edge, hardware gate edge, PCNT ISR
+   delivery, capture ISR delivery, encoder ISR delivery, gate ISR delivery,
+   gate timer callback.
+
+   The capture ISR dates its edge like the board: the capture register holds
+   the latest rising edge at the time it is read (cap_read after ISR entry,
+   overwritten by every edge since the armed one), as a 32 bit counter off
+   the timebase by cap_align ticks, and the age is taken against
+   fm_hal_now() read now_read after entry. With now_read < cap_read an edge
+   can land between the two reads and be dated after now.
+
+   Encoder edges latch like the board's capture 1 (A, both edges, with the
+   polarity of the latest) and capture 2 (B rising): the edge set state
+   machine runs in the ISR, isr_latency after the first pending edge, on
+   whatever the two registers hold by then.
+
+   Callbacks run atomically, so fm_hal_lock() has nothing to do here; an overflow between
+   the counter wrap and ISR delivery (isr_latency) is visible to callbacks,
+   exactly like a pending interrupt on the board.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fm_sim.h"
+#include "fm_trace.h"
+
+#define SIM_HISTORY           16384                                       // Segments of phase history kept per unit
+#define SIM_NEVER             UINT64_MAX                                  // No event scheduled
+
+typedef struct {
+  uint64_t t;                                                             // Segment start, ticks
+  double   phase;                                                         // Phase at t, cycles
+  double   freq;                                                          // Frequency during the segment
+} sim_seg_t;
+
+typedef struct {
+  fm_sim_signal_t sig;
+  bool      active;                                                       // Signal attached
+  bool      used;                                                         // PCNT unit configured
+  int       gpio;                                                         // Input GPIO
+  int16_t   h_lim;                                                        // Counter high limit (quadrature: +-h_lim)
+  bool      quad;                                                         // Quadrature decoder, A = gpio
+  int       gpio_b;                                                       // Quadrature B input
+  double    duty;                                                         // Encoder A high share
+  double    phase_b;                                                      // Encoder B delay, cycles
+  int       lim_dir;                                                      // Last limit reached, 1 high, -1 low
+  int64_t   pos0;                                                         // Quadrature count at set up
+  int32_t   count;                                                        // Counter value
+  double    phase;                                                        // Phase at sim.now, cycles
+  double    freq;                                                         // Current segment frequency
+  int64_t   edges;                                                        // floor(2 * phase) at sim.now, quadrature: position
+  sim_seg_t hist[SIM_HISTORY];                                            // Phase history ring
+  uint32_t  hist_n;                                                       // Segments written
+} sim_unit_t;
+
+static struct {
+  fm_sim_config_t cfg;
+  fm_sim_stats_t  stats;
+  uint64_t        now;                                                    // Simulated time, ticks
+  uint64_t        seg_next;                                               // Next segment boundary
+  int             ctrl;                                                   // Counting control level
+  struct {                                                                // PCNT ISR handlers
+    uint32_t      units;
+    fm_hal_isr_t  fn;
+    void         *arg;
+  } isr[FM_HAL_PCNT_ISRS];
+  int             nisr;
+  uint32_t        irq_status;                                             // Units with a pending event
+  uint64_t        irq_at;                                                 // ISR delivery time
+  fm_hal_cb_t     timer_cb;
+  void           *timer_arg;
+  uint64_t        timer_at;                                               // Gate timer expiry
+  uint64_t        timer_period;                                           // Periodic timer period, 0 = one-shot
+  uint64_t        timer_nominal;                                          // Expiry without latency and jitter
+  fm_hal_capture_cb_t cap_cb;
+  void           *cap_arg;
+  int             cap_unit;                                               // Unit whose input is captured
+  bool            cap_armed;                                              // Waiting for a rising edge
+  uint64_t        cap_at;                                                 // Next rising edge while armed
+  uint64_t        cap_isr_at;                                             // Capture ISR delivery
+  fm_hal_edges_cb_t enc_cb;
+  void           *enc_arg;
+  int             enc_unit;                                               // Quadrature unit whose edges are taken
+  bool            enc_armed;
+  uint64_t        enc_at;                                                 // Next encoder transition while armed
+  int             enc_kind;                                               // 0 A rise, 1 A fall, 2 B rise
+  uint64_t        enc_isr_at;                                             // Encoder capture ISR delivery
+  uint32_t        enc_status;                                             // 1 A captured, 2 B captured since the ISR
+  uint64_t        enc_reg[2];                                             // Capture registers: latest A edge, latest B rise
+  bool            enc_fall;                                               // Latest A edge was a fall
+  uint64_t        enc_t[4];                                               // A rise, A fall, B rise, next A rise
+  uint8_t         enc_seen;                                               // Bit per enc_t entry taken
+  fm_hal_capture_cb_t gate_cb;                                            // Hardware gate, NULL = control output
+  void           *gate_arg;
+  uint64_t        gate_high;                                              // Gate, ticks
+  uint64_t        gate_period;                                            // Gate to gate, ticks
+  uint64_t        gate_at;                                                // Next gate edge
+  uint64_t        gate_isr_at;                                            // Gate ISR delivery
+  int             ledc_unit;                                              // Unit driven by the LEDC output, -1 = none
+  uint64_t        rng;                                                    // xorshift64* state
+} sim;
+
+static sim_unit_t units[FM_SIM_UNITS];
+
+//----------------------------------------------------------------------------------
+static uint64_t sim_host_ns(void)                                         // Host clock, for callback cost
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//----------------------------------------------------------------------------------
+static double sim_uniform(void)                                           // 0 <= x < 1
+{
+  sim.rng ^= sim.rng >> 12;
+  sim.rng ^= sim.rng << 25;
+  sim.rng ^= sim.rng >> 27;
+  return (double)((sim.rng * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+//----------------------------------------------------------------------------------
+static double sim_gauss(void)                                             // Standard normal, Box-Muller
+{
+  double u1 = sim_uniform();
+  double u2 = sim_uniform();
+  if (u1 < 1e-300) u1 = 1e-300;
+  return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+//----------------------------------------------------------------------------------
+static bool sim_counting(const sim_unit_t *u)
+{
+  return u->used && (u->quad || sim.ctrl);                                // hctrl KEEP, lctrl DISABLE
+}
+
+//----------------------------------------------------------------------------------
+static void quad_offsets(const sim_unit_t *u, double o[4])                // Transition phases in a cycle, ascending
+{
+  o[0] = 0;                                                               // A rise
+  o[1] = u->duty;                                                         // A fall
+  o[2] = u->phase_b;                                                      // B rise
+  o[3] = fmod(u->phase_b + u->duty, 1.0);                                 // B fall
+  for (int i = 1; i < 4; i++)
+    for (int j = i; j > 0 && o[j] < o[j - 1]; j--) {
+      double t = o[j];
+      o[j] = o[j - 1];
+      o[j - 1] = t;
+    }
+}
+
+//----------------------------------------------------------------------------------
+static int64_t quad_pos(const sim_unit_t *u, double phase)                // x4 count at a phase
+{
+  double o[4];
+  quad_offsets(u, o);
+  int64_t pos = 0;
+  for (int i = 0; i < 4; i++) pos += (int64_t)floor(phase - o[i]);
+  return pos;
+}
+
+//----------------------------------------------------------------------------------
+static double quad_phase(const sim_unit_t *u, int64_t pos)                // Lowest phase with quad_pos == pos
+{
+  double o[4];
+  quad_offsets(u, o);
+  int j = (int)(((pos + 3) % 4 + 4) % 4);                                 // On [k + o[j], k + o[j + 1]) pos = 4k + j - 3
+  int64_t k = (pos + 3 - j) / 4;
+  return (double)k + o[j];
+}
+
+//----------------------------------------------------------------------------------
+static uint64_t sim_isr_delay(void)                                       // Event to ISR entry
+{
+  uint64_t jitter = sim.cfg.isr_jitter ? (uint64_t)(sim_uniform() * (sim.cfg.isr_jitter + 1)) : 0;
+  return sim.cfg.isr_latency + jitter;
+}
+
+//----------------------------------------------------------------------------------
+static void sim_raise(int unit)                                           // Counter event -> pending interrupt
+{
+  sim.irq_status |= 1u << unit;
+  if (sim.irq_at == SIM_NEVER) sim.irq_at = sim.now + sim_isr_delay();
+}
+
+//----------------------------------------------------------------------------------
+static uint64_t sim_next_rise(const sim_unit_t *u)                        // First tick at or after the next rising edge
+{
+  if (!u->active || u->freq <= 0) return SIM_NEVER;                       // Re-evaluated at the next segment
+  double ticks = ceil((floor(u->phase) + 1.0 - u->phase) / u->freq * FM_TIMEBASE_HZ);
+  if (ticks < 1) ticks = 1;
+  if (ticks > 1e18) return SIM_NEVER;
+  return sim.now + (uint64_t)ticks;
+}
+
+//----------------------------------------------------------------------------------
+static uint64_t sim_last_rise(const sim_unit_t *u, uint64_t at)           // Tick latching the latest rising edge at or before at
+{
+  if (at > sim.now && u->freq > 0) {                                      // Ahead of now, within the current segment
+    double p = u->phase + u->freq * (double)(at - sim.now) / FM_TIMEBASE_HZ;
+    double k = floor(p);
+    if (k > floor(u->phase)) return sim.now + (uint64_t)ceil((k - u->phase) / u->freq * FM_TIMEBASE_HZ);
+  }
+  double k = floor(u->phase);                                             // Rising edges at integer phase
+  uint32_t lo = u->hist_n > SIM_HISTORY ? u->hist_n - SIM_HISTORY : 0;
+  for (uint32_t i = u->hist_n; i-- > lo; ) {                              // Newest segment first
+    const sim_seg_t *h = &u->hist[i % SIM_HISTORY];
+    if (h->phase > k) continue;                                           // Edge is before this segment
+    double t = (double)h->t + (h->freq > 0 ? (k - h->phase) / h->freq * FM_TIMEBASE_HZ : 0);
+    return (uint64_t)ceil(t);
+  }
+  return u->hist[lo % SIM_HISTORY].t;                                     // Older than the history
+}
+
+//----------------------------------------------------------------------------------
+static uint64_t sim_capture_time(void)                                    // capture_time() of the board, at ISR entry
+{
+  uint64_t t = sim.now + sim.cfg.now_read;
+  uint64_t now = t - t % sim.cfg.now_res;
+  uint32_t cap = (uint32_t)(sim_last_rise(&units[sim.cap_unit], sim.now + sim.cfg.cap_read) + sim.cfg.cap_align);
+  int32_t age = (int32_t)((uint32_t)now - cap);                           // Signed, as on the board
+  return age > 0 ? now - (uint32_t)age : now;
+}
+
+//----------------------------------------------------------------------------------
+static void sim_segment(sim_unit_t *u)                                    // New frequency for the next segment
+{
+  double t = (double)sim.now / FM_TIMEBASE_HZ;
+  double f = u->sig.freq_hz + u->sig.drift_hz_s * t;
+
+  if (u->sig.noise_ppm > 0) f *= 1.0 + u->sig.noise_ppm * 1e-6 * sim_gauss();
+  if (u->sig.burst_on_s > 0 && u->sig.burst_off_s > 0 &&
+      fmod(t, u->sig.burst_on_s + u->sig.burst_off_s) >= u->sig.burst_on_s) f = 0;
+  if (f < 0 && !u->quad) f = 0;                                           // Only an encoder runs backwards
+  u->freq = f;
+
+  sim_seg_t *h = &u->hist[u->hist_n % SIM_HISTORY];
+  h->t = sim.now;
+  h->phase = u->phase;
+  h->freq = f;
+  u->hist_n++;
+}
+
+//----------------------------------------------------------------------------------
+static void sim_advance(uint64_t t)                                       // Move all inputs and counters to t
+{
+  double dt = (double)(t - sim.now) / FM_TIMEBASE_HZ;
+  sim.now = t;
+  for (int i = 0; i < FM_SIM_UNITS; i++) {
+    sim_unit_t *u = &units[i];
+    if (!u->active) continue;
+    u->phase += u->freq * dt;
+    if (u->quad) {                                                        // Up and down, limit resets to 0 either way
+      int64_t p = quad_pos(u, u->phase);
+      if (!u->used || p == u->edges) continue;
+      u->count += (int32_t)(p - u->edges);
+      u->edges = p;
+      while (u->count >= u->h_lim || u->count <= -u->h_lim) {
+        u->lim_dir = u->count > 0 ? 1 : -1;
+        u->count -= u->lim_dir * u->h_lim;
+        sim_raise(i);
+      }
+      continue;
+    }
+    int64_t e = (int64_t)floor(2.0 * u->phase);
+    int64_t d = e - u->edges;
+    u->edges = e;
+    if (!sim_counting(u) || d == 0) continue;
+    u->count += (int32_t)d;
+    while (u->count >= u->h_lim) {                                        // H_LIM reached: counter resets to 0
+      u->count -= u->h_lim;
+      sim_raise(i);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------
+static uint64_t sim_limit_time(const sim_unit_t *u)                       // When the counter reaches h_lim
+{
+  if (u->quad && u->active && u->used && u->freq != 0) {                  // Either limit, in the direction of travel
+    double target = u->freq > 0 ? quad_phase(u, u->edges + (u->h_lim - u->count)) :
+                                  quad_phase(u, u->edges - (u->h_lim + u->count) + 1);
+    double ticks = ceil((target - u->phase) / u->freq * FM_TIMEBASE_HZ);
+    if (ticks < 1) ticks = 1;
+    if (ticks > 1e18) return SIM_NEVER;
+    return sim.now + (uint64_t)ticks;
+  }
+  if (!u->active || !sim_counting(u) || u->freq <= 0) return SIM_NEVER;
+  double target = (double)(u->edges + (u->h_lim - u->count)) / 2.0;       // Phase of the h_lim-th edge
+  double ticks = ceil((target - u->phase) / u->freq * FM_TIMEBASE_HZ);
+  if (ticks < 1) ticks = 1;
+  if (ticks > 1e18) return SIM_NEVER;
+  return sim.now + (uint64_t)ticks;
+}
+
+//----------------------------------------------------------------------------------
+static uint64_t sim_next_transition(const sim_unit_t *u, int *kind)       // Next A rise, A fall or B rise of an encoder
+{
+  if (!u->active || u->freq == 0) return SIM_NEVER;
+  double fwd[3] = { 0, u->duty, u->phase_b };                             // Crossed upwards going forwards
+  double bwd[3] = { u->duty, 0, fmod(u->phase_b + u->duty, 1.0) };        // Crossed downwards going backwards
+  uint64_t best = SIM_NEVER;
+  for (int k = 0; k < 3; k++) {
+    double o = u->freq > 0 ? fwd[k] : bwd[k];
+    double p = u->freq > 0 ? floor(u->phase - o) + 1 + o : ceil(u->phase - o) - 1 + o;
+    double ticks = ceil((p - u->phase) / u->freq * FM_TIMEBASE_HZ);
+    if (ticks < 1) ticks = 1;
+    if (ticks > 1e18) continue;
+    if (sim.now + (uint64_t)ticks < best) {
+      best = sim.now + (uint64_t)ticks;
+      *kind = k;
+    }
+  }
+  return best;
+}
+
+//----------------------------------------------------------------------------------
+static void sim_encoder_edge(void)                                        // Edge latched in its capture register
+{
+  if (sim.enc_kind == 2) {
+    sim.enc_reg[1] = sim.now;
+    sim.enc_status |= 2;
+  } else {
+    sim.enc_reg[0] = sim.now;                                             // A rise and fall share one register
+    sim.enc_fall = sim.enc_kind == 1;
+    sim.enc_status |= 1;
+  }
+  if (sim.enc_isr_at == SIM_NEVER) sim.enc_isr_at = sim.now + sim_isr_delay();
+  sim.enc_at = sim_next_transition(&units[sim.enc_unit], &sim.enc_kind);
+}
+
+//----------------------------------------------------------------------------------
+static void sim_encoder_isr(void)                                         // Edge set state machine, as on the board
+{
+  uint32_t status = sim.enc_status;                                       // Registers as they are now: an edge
+  sim.enc_status = 0;                                                     // overwritten before the ISR is lost
+  sim.stats.edge_calls++;
+  if (status & 1) {
+    uint64_t t = sim.enc_reg[0];
+    if (sim.enc_fall) {
+      if ((sim.enc_seen & 1) && !(sim.enc_seen & 2)) {
+        sim.enc_t[1] = t;
+        sim.enc_seen |= 2;
+      }
+    } else if (!(sim.enc_seen & 1) || (sim.enc_seen & 6) != 6) {
+      sim.enc_t[0] = t;
+      sim.enc_seen = 1;
+    } else {
+      sim.enc_t[3] = t;
+      sim.enc_seen |= 8;
+    }
+  }
+  if ((status & 2) && (sim.enc_seen & 1) && !(sim.enc_seen & 4)) {
+    sim.enc_t[2] = sim.enc_reg[1];
+    sim.enc_seen |= 4;
+  }
+  if (sim.enc_seen == 15) {
+    sim.enc_armed = false;                                                // Interrupts off until the next arm
+    sim.enc_at = SIM_NEVER;
+    if (sim.enc_cb) sim.enc_cb(sim.enc_t, sim.enc_arg);
+  }
+}
+
+//----------------------------------------------------------------------------------
+static void sim_timer_arm(void)                                           // Expiry = nominal + dispatch latency + jitter
+{
+  uint64_t jitter = sim.cfg.timer_jitter ? (uint64_t)(sim_uniform() * (sim.cfg.timer_jitter + 1)) : 0;
+  sim.timer_at = sim.timer_nominal + sim.cfg.timer_latency + jitter;
+}
+
+//----------------------------------------------------------------------------------
+void fm_sim_default_config(fm_sim_config_t *cfg)
+{
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->timer_latency = 80 * 20;                                           // 20 us esp-timer task dispatch
+  cfg->timer_jitter  = 80 * 10;                                           // up to 10 us more
+  cfg->isr_latency   = 80;                                                // 1 us
+  cfg->isr_jitter    = 16;                                                // up to 0.2 us more
+  cfg->now_res       = FM_HAL_NOW_RES;                                    // Timer group at APB / 2
+  cfg->now_read      = 4;                                                 // Capture registers read first, then the timebase
+  cfg->segment       = 80000;                                             // 1 ms
+  cfg->seed          = 1;
+}
+
+//----------------------------------------------------------------------------------
+void fm_sim_reset(const fm_sim_config_t *cfg)
+{
+  memset(&sim, 0, sizeof(sim));
+  memset(units, 0, sizeof(units));
+  sim.cfg = *cfg;
+  if (sim.cfg.segment == 0) sim.cfg.segment = 80000;
+  if (sim.cfg.now_res == 0) sim.cfg.now_res = 1;
+  sim.rng = 0x9E3779B97F4A7C15ULL ^ cfg->seed;
+  sim.seg_next = sim.cfg.segment;
+  sim.irq_at = SIM_NEVER;
+  sim.timer_at = SIM_NEVER;
+  sim.cap_at = SIM_NEVER;
+  sim.cap_isr_at = SIM_NEVER;
+  sim.enc_at = SIM_NEVER;
+  sim.enc_isr_at = SIM_NEVER;
+  sim.gate_at = SIM_NEVER;
+  sim.gate_isr_at = SIM_NEVER;
+  sim.ledc_unit = -1;
+  for (int i = 0; i < FM_SIM_UNITS; i++) fm_sim_set_encoder(i, 0.5, 90);
+}
+
+//----------------------------------------------------------------------------------
+void fm_sim_set_signal(int unit, const fm_sim_signal_t *sig)
+{
+  sim_unit_t *u = &units[unit];
+  u->sig = *sig;
+  u->active = true;
+  u->phase = sim_uniform();                                               // Random initial phase
+  u->edges = u->quad ? quad_pos(u, u->phase) : (int64_t)floor(2.0 * u->phase);
+  u->pos0 = u->edges;
+  sim_segment(u);
+}
+
+//----------------------------------------------------------------------------------
+void fm_sim_set_encoder(int unit, double duty, double phase_deg)
+{
+  sim_unit_t *u = &units[unit];
+  u->duty = duty;
+  u->phase_b = fmod(phase_deg / 360.0 + 1.0, 1.0);
+  if (u->quad) u->edges = u->pos0 = quad_pos(u, u->phase);
+}
+
+//----------------------------------------------------------------------------------
+bool fm_sim_step(uint64_t until)
+{
+  uint64_t next = until;
+  if (sim.seg_next < next) next = sim.seg_next;
+  if (sim.irq_at < next) next = sim.irq_at;
+  if (sim.timer_at < next) next = sim.timer_at;
+  if (sim.cap_at < next) next = sim.cap_at;
+  if (sim.cap_isr_at < next) next = sim.cap_isr_at;
+  if (sim.enc_at < next) next = sim.enc_at;
+  if (sim.enc_isr_at < next) next = sim.enc_isr_at;
+  if (sim.gate_at < next) next = sim.gate_at;
+  if (sim.gate_isr_at < next) next = sim.gate_isr_at;
+  for (int i = 0; i < FM_SIM_UNITS; i++) {
+    uint64_t t = sim_limit_time(&units[i]);
+    if (t < next) next = t;
+  }
+
+  sim_advance(next);
+  sim.stats.events++;
+
+  if (sim.now >= sim.seg_next) {
+    for (int i = 0; i < FM_SIM_UNITS; i++)
+      if (units[i].active) sim_segment(&units[i]);
+    sim.seg_next += sim.cfg.segment;
+    if (sim.cap_armed) sim.cap_at = sim_next_rise(&units[sim.cap_unit]);  // New frequency, new edge time
+    if (sim.enc_armed) sim.enc_at = sim_next_transition(&units[sim.enc_unit], &sim.enc_kind);
+  }
+  if (sim.now >= sim.cap_at) {                                            // Edge latched, interrupt on its way
+    sim.cap_at = SIM_NEVER;
+    sim.cap_armed = false;
+    sim.cap_isr_at = sim.now + sim_isr_delay();
+  }
+  if (sim.now >= sim.enc_at) sim_encoder_edge();                          // Timestamp latched, interrupt on its way
+  if (sim.now >= sim.gate_at) {                                           // Hardware gate edge, counting follows at once
+    sim.ctrl = !sim.ctrl;
+    sim.gate_at = sim.now + (sim.ctrl ? sim.gate_high : sim.gate_period - sim.gate_high);
+    if (!sim.ctrl) sim.gate_isr_at = sim.now + sim_isr_delay();
+  }
+  if (sim.now >= sim.irq_at) {
+    uint32_t status = sim.irq_status;
+    sim.irq_status = 0;
+    sim.irq_at = SIM_NEVER;
+    sim.stats.isr_calls++;
+    sim.stats.isr_units += __builtin_popcount(status);
+    uint64_t h = sim_host_ns();
+    uint32_t t0 = FM_TRACE_STAMP();
+    for (int i = 0; i < sim.nisr; i++)
+      if (status & sim.isr[i].units) sim.isr[i].fn(status & sim.isr[i].units, sim.isr[i].arg);
+    FM_TRACE_COUNT(FM_TRACE_PCNT_IRQS, 1);
+    FM_TRACE_SPAN(FM_TRACE_PCNT_ISR, t0);
+    sim.stats.isr_host_ns += sim_host_ns() - h;
+  }
+  if (sim.now >= sim.cap_isr_at) {
+    sim.cap_isr_at = SIM_NEVER;
+    sim.stats.capture_calls++;
+    if (sim.cap_cb) sim.cap_cb(sim_capture_time(), sim.cap_arg);
+  }
+  if (sim.now >= sim.enc_isr_at) {
+    sim.enc_isr_at = SIM_NEVER;
+    if (sim.enc_armed) sim_encoder_isr();
+  }
+  if (sim.now >= sim.gate_isr_at) {
+    sim.gate_isr_at = SIM_NEVER;
+    sim.stats.gate_calls++;
+    if (sim.gate_cb) sim.gate_cb(fm_hal_now(), sim.gate_arg);
+  }
+  if (sim.now >= sim.timer_at) {
+    sim.timer_at = SIM_NEVER;
+    if (sim.timer_period) {                                               // Next expiry from the nominal time, like esp_timer
+      sim.timer_nominal += sim.timer_period;
+      sim_timer_arm();
+    }
+    sim.stats.timer_calls++;
+    uint64_t h = sim_host_ns();
+    if (sim.timer_cb) sim.timer_cb(sim.timer_arg);
+    sim.stats.timer_host_ns += sim_host_ns() - h;
+  }
+  return sim.now < until;
+}
+
+//----------------------------------------------------------------------------------
+void fm_sim_run(uint64_t ticks)
+{
+  uint64_t until = sim.now + ticks;
+  while (fm_sim_step(until)) { }
+}
+
+//----------------------------------------------------------------------------------
+uint64_t fm_sim_now(void)
+{
+  return sim.now;
+}
+
+//----------------------------------------------------------------------------------
+double fm_sim_phase_at(int unit, uint64_t t)
+{
+  const sim_unit_t *u = &units[unit];
+  if (!u->active || u->hist_n == 0) return NAN;
+  if (t >= sim.now) return u->phase + u->freq * (double)(t - sim.now) / FM_TIMEBASE_HZ;
+
+  uint32_t lo = u->hist_n > SIM_HISTORY ? u->hist_n - SIM_HISTORY : 0;    // Oldest segment kept
+  uint32_t hi = u->hist_n - 1;
+  if (u->hist[lo % SIM_HISTORY].t > t) return NAN;                        // Out of history
+  while (lo < hi) {                                                       // Last segment starting at or before t
+    uint32_t mid = lo + (hi - lo + 1) / 2;
+    if (u->hist[mid % SIM_HISTORY].t <= t) lo = mid; else hi = mid - 1;
+  }
+  const sim_seg_t *h = &u->hist[lo % SIM_HISTORY];
+  return h->phase + h->freq * (double)(t - h->t) / FM_TIMEBASE_HZ;
+}
+
+//----------------------------------------------------------------------------------
+void fm_sim_connect_ledc(int unit)
+{
+  sim.ledc_unit = unit;
+}
+
+//----------------------------------------------------------------------------------
+static void sim_ledc(uint32_t div, uint32_t resolution)                   // New oscillator frequency, from now
+{
+  if (sim.ledc_unit < 0) return;
+  sim_unit_t *u = &units[sim.ledc_unit];
+  fm_sim_signal_t sig = { 0 };
+  sig.freq_hz = 80e6 * 256.0 / ((double)div * (1u << resolution));
+  if (!u->active) {
+    fm_sim_set_signal(sim.ledc_unit, &sig);
+    return;
+  }
+  u->sig = sig;                                                           // Phase continues, as the timer is not reset
+  sim_segment(u);
+  if (sim.cap_armed) sim.cap_at = sim_next_rise(&units[sim.cap_unit]);
+  if (sim.enc_armed) sim.enc_at = sim_next_transition(&units[sim.enc_unit], &sim.enc_kind);
+}
+
+//----------------------------------------------------------------------------------
+int64_t fm_sim_position(int unit)
+{
+  return units[unit].edges - units[unit].pos0;
+}
+
+//----------------------------------------------------------------------------------
+void fm_sim_get_stats(fm_sim_stats_t *stats)
+{
+  *stats = sim.stats;
+}
+
+//==================================================================================
+// fm_hal.h
+//==================================================================================
+
+void fm_hal_init(void)
+{
+}
+
+void fm_hal_pcnt_init(int unit, int sig_gpio, int ctrl_gpio, int16_t h_lim)
+{
+  (void)ctrl_gpio;
+  units[unit].used = true;
+  units[unit].gpio = sig_gpio;
+  units[unit].h_lim = h_lim;
+  units[unit].count = 0;
+}
+
+void fm_hal_pcnt_quad_init(int unit, int a_gpio, int b_gpio, int16_t lim)
+{
+  sim_unit_t *u = &units[unit];
+  u->used = true;
+  u->quad = true;
+  u->gpio = a_gpio;
+  u->gpio_b = b_gpio;
+  u->h_lim = lim;
+  u->count = 0;
+  u->edges = u->pos0 = quad_pos(u, u->phase);
+}
+
+void fm_hal_pcnt_isr_register(uint32_t units_mask, fm_hal_isr_t isr, void *arg)
+{
+  int i = 0;
+  while (i < sim.nisr && sim.isr[i].fn != isr) i++;
+  if (i == FM_HAL_PCNT_ISRS) return;
+  sim.isr[i].units = units_mask;
+  sim.isr[i].fn = isr;
+  sim.isr[i].arg = arg;
+  if (i == sim.nisr) sim.nisr++;
+}
+
+int16_t fm_hal_pcnt_get(int unit)
+{
+  return (int16_t)units[unit].count;
+}
+
+void fm_hal_pcnt_clear(int unit)
+{
+  units[unit].count = 0;
+}
+
+uint32_t fm_hal_pcnt_overflow_pending(void)
+{
+  return sim.irq_status;
+}
+
+int fm_hal_pcnt_limit_dir(int unit)
+{
+  return units[unit].lim_dir;
+}
+
+void fm_hal_ctrl_init(int gpio)
+{
+  (void)gpio;
+  sim.ctrl = 0;
+}
+
+void fm_hal_ctrl_set(int level)
+{
+  if (sim.gate_cb) {                                                      // Gate waveform off, output held at level
+    sim.gate_at = SIM_NEVER;
+    if (sim.ctrl && !level) sim.gate_isr_at = sim.now + sim_isr_delay();  // The fall interrupts as well
+  }
+  sim.ctrl = level;
+}
+
+void fm_hal_gate_init(int gpio, fm_hal_capture_cb_t cb, void *arg)
+{
+  (void)gpio;
+  sim.gate_cb = cb;
+  sim.gate_arg = arg;
+  sim.ctrl = 0;
+}
+
+uint64_t fm_hal_gate_start(uint32_t div, uint32_t resolution, uint32_t duty)
+{
+  sim.gate_period = ((uint64_t)div << resolution) >> 8;
+  sim.gate_high = ((uint64_t)div * duty) >> 8;
+  sim.ctrl = 1;                                                           // Opens now
+  sim.gate_at = sim.now + sim.gate_high;
+  return fm_hal_now();
+}
+
+void fm_hal_timer_create(fm_hal_cb_t cb, void *arg)
+{
+  sim.timer_cb = cb;
+  sim.timer_arg = arg;
+}
+
+void fm_hal_timer_start_once(uint64_t us)
+{
+  sim.timer_period = 0;
+  sim.timer_nominal = sim.now + us * (FM_TIMEBASE_HZ / 1000000);
+  sim_timer_arm();
+}
+
+void fm_hal_timer_start_periodic(uint64_t us)
+{
+  sim.timer_period = us * (FM_TIMEBASE_HZ / 1000000);
+  sim.timer_nominal = sim.now + sim.timer_period;
+  sim_timer_arm();
+}
+
+void fm_hal_timer_stop(void)
+{
+  sim.timer_period = 0;
+  sim.timer_at = SIM_NEVER;
+}
+
+uint64_t fm_hal_now(void)
+{
+  return sim.now - sim.now % sim.cfg.now_res;
+}
+
+uint32_t fm_hal_cycles(void)
+{
+  return (uint32_t)(sim_host_ns() * (FM_HAL_CYCLES_HZ / 1000000) / 1000); // Host time: spans are the host's CPU time
+}
+
+void fm_hal_capture_init(int gpio, fm_hal_capture_cb_t cb, void *arg)
+{
+  sim.cap_cb = cb;
+  sim.cap_arg = arg;
+  sim.cap_unit = 0;
+  for (int i = 0; i < FM_SIM_UNITS; i++)
+    if (units[i].used && units[i].gpio == gpio) sim.cap_unit = i;
+}
+
+void fm_hal_capture_arm(void)
+{
+  sim.cap_armed = true;
+  sim.cap_at = sim_next_rise(&units[sim.cap_unit]);
+}
+
+void fm_hal_edges_init(int a_gpio, int b_gpio, fm_hal_edges_cb_t cb, void *arg)
+{
+  (void)b_gpio;
+  sim.enc_cb = cb;
+  sim.enc_arg = arg;
+  sim.enc_unit = 0;
+  for (int i = 0; i < FM_SIM_UNITS; i++)
+    if (units[i].quad && units[i].gpio == a_gpio) sim.enc_unit = i;
+}
+
+void fm_hal_edges_arm(void)
+{
+  sim.enc_armed = true;
+  sim.enc_seen = 0;
+  sim.enc_status = 0;                                                     // Forget edges before now
+  sim.enc_isr_at = SIM_NEVER;
+  sim.enc_at = sim_next_transition(&units[sim.enc_unit], &sim.enc_kind);
+}
+
+void fm_hal_lock(void)
+{
+}
+
+void fm_hal_unlock(void)
+{
+}
+
+void fm_hal_ledc_config(int gpio, uint32_t div, uint32_t resolution, uint32_t duty)
+{
+  (void)gpio;
+  (void)duty;
+  sim_ledc(div, resolution);
+}
+
+void fm_hal_ledc_retune(uint32_t div, uint32_t resolution)
+{
+  sim_ledc(div, resolution);
+}
+
+void fm_hal_ledc_duty(uint32_t duty)
+{
+  (void)duty;
+}
+
+void fm_hal_gpio_mirror(int in_gpio, int out_gpio)
+{
+  (void)in_gpio;
+  (void)out_gpio;
+}
+
+void fm_hal_console_init(void)
+{
+}
+
+void fm_hal_serial_write(const void *data, size_t len)
+{
+  fwrite(data, 1, len, stdout);                                           // Console of the simulated board
+}
+
+int fm_hal_console_read(char *buf, int size, uint32_t timeout_us)
+{
+  (void)buf;                                                              // Nothing typed: the host submits lines itself
+  (void)size;
+  (void)timeout_us;
+  return 0;
+}
+
+void fm_hal_task_create(const char *name, fm_hal_task_t fn, void *arg, uint32_t stack, int priority)
+{
+  (void)name;                                                             // No threads: the host calls the task's work itself
+  (void)fn;
+  (void)arg;
+  (void)stack;
+  (void)priority;
+}
+
+void fm_hal_sleep_us(uint64_t us)
+{
+  fm_sim_run(us * (FM_TIMEBASE_HZ / 1000000));                            // Top level only, not from a callback
+}
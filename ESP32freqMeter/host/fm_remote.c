@@ -0,0 +1,204 @@
+/* ESP32 Frequency Meter - remote command harness on the host simulator
+
+   Pipes a command script through the board's command code (fm_cmd.h): each
+   line is parsed and queued as the command task does, then the simulated
+   meter loop runs, as app_main does, until the line's response comes back.
+   The LEDC oscillator drives the input, so GENerator, MEASure? and the
+   statistics answer with real readings.
+
+   Per line it prints the command, the response and
+     latency  line complete -> response written, simulated board time
+     parse    host time to parse and queue the line
+     exec     host time of the fm_cmd_service() call that ran it
+   then the same figures per command. MEASure? latency includes the wait
+   for a gate opened after the command.
+
+   Script lines: commands as sent on the console, '#' comments, and
+   WAIT <ms> to let the meter run without commands.
+
+   Usage: fm_remote [script|-]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fm_cmd.h"
+#include "fm_core.h"
+#include "fm_gen.h"
+#include "fm_sim.h"
+#include "fm_stats.h"
+#include "fm_trace.h"
+
+#define TICKS_PER_US          (FM_TIMEBASE_HZ / 1000000)
+#define RTOS_TICK             (FM_TIMEBASE_HZ / 1000)                     // FreeRTOS tick, 1 ms
+#define TIMEOUT_TICKS         ((uint64_t)30 * FM_TIMEBASE_HZ)             // No response after 30 s of board time
+#define GROUPS                24                                          // Commands summarized
+#define SHOW_MAX              40                                          // Response characters printed
+
+typedef struct {
+  char     name[20];                                                      // Header as written, upper case
+  uint32_t n;
+  double   latency_us;                                                    // Sums
+  double   latency_max_us;
+  double   parse_ns;
+  double   exec_ns;
+} group_t;
+
+static fm_stats_t       stats;
+static fm_gen_setting_t gen;
+static fm_gen_sweep_t   sweep;
+static fm_cmd_ctx_t     ctx;
+static char             response[FM_CMD_RESP_MAX];                        // Last response line, without '\n'
+static bool             answered  = false;
+static uint64_t         answer_at = 0;                                    // Simulated time of the response
+static uint64_t         exec_ns   = 0;                                    // Host time of the service call that answered
+static group_t          groups[GROUPS];
+static int              ngroups   = 0;
+
+//----------------------------------------------------------------------------------
+static uint64_t host_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//----------------------------------------------------------------------------------
+static void remote_write(const char *text, int len, void *arg)            // Console of the simulated board
+{
+  (void)arg;
+  if (len > 0 && text[len - 1] == '\n') len--;
+  memcpy(response, text, len);
+  response[len] = 0;
+  answered = true;
+  answer_at = fm_sim_now();
+}
+
+//----------------------------------------------------------------------------------
+static void loop_once(void)                                               // One pass of app_main
+{
+  fm_result_t res;
+  bool idle = true;
+  FM_TRACE_LOOP();
+  while (fm_meter_poll(&res)) {                                           // Every finished gate in the ring
+    idle = false;
+    if (res.channel == ctx.channel) fm_stats_add(&stats, &res);
+    uint64_t t0 = host_ns();
+    fm_cmd_reading(&ctx, &res);                                           // MEASure?
+    if (answered && !exec_ns) exec_ns = host_ns() - t0;
+  }
+  if (!idle) fm_meter_start();
+  uint64_t t0 = host_ns();
+  if (fm_cmd_service(&ctx)) exec_ns = host_ns() - t0;
+  fm_gen_sweep_poll(&sweep);
+  if (idle) fm_sim_run(RTOS_TICK - fm_sim_now() % RTOS_TICK);             // vTaskDelay(1): up to the next tick
+}
+
+//----------------------------------------------------------------------------------
+static group_t *group(const char *line)                                   // Summary row of the line's header
+{
+  char name[sizeof(groups[0].name)];
+  int len = 0;
+  while (*line == ' ' || *line == '\t') line++;
+  for (; line[len] && line[len] != ' ' && line[len] != '\t' && len < (int)sizeof(name) - 1; len++)
+    name[len] = line[len] >= 'a' && line[len] <= 'z' ? line[len] - 'a' + 'A' : line[len];
+  name[len] = 0;
+  if (len && name[0] >= '0' && name[0] <= '9') strcpy(name, "<number>");
+  for (int i = 0; i < ngroups; i++)
+    if (strcmp(groups[i].name, name) == 0) return &groups[i];
+  if (ngroups == GROUPS) return NULL;
+  group_t *g = &groups[ngroups++];
+  memset(g, 0, sizeof(*g));
+  strcpy(g->name, name);
+  return g;
+}
+
+//----------------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+  FILE *in = stdin;
+  if (argc > 1 && strcmp(argv[1], "-") != 0 && !(in = fopen(argv[1], "r"))) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  fm_sim_config_t simcfg;
+  fm_sim_default_config(&simcfg);
+  fm_sim_reset(&simcfg);
+  fm_sim_connect_ledc(0);                                                 // GPIO 25 wired to GPIO 34
+  fm_gen_init(25);
+  fm_gen_set(1000000, 500, &gen);                                         // 1 kHz, as ledcInit
+
+  fm_config_t cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.unit          = 0;
+  cfg.sig_gpio      = 34;
+  cfg.ctrl_gpio     = 35;
+  cfg.out_ctrl_gpio = 32;
+  cfg.sample_time   = 1000000;
+  cfg.mode          = FM_MODE_AUTO;
+  cfg.range.resolution_ppb = 1000;
+  fm_meter_init(&cfg);
+  fm_stats_reset(&stats);
+  ctx.stream = true;
+  ctx.stats  = &stats;
+  ctx.gen    = &gen;
+  ctx.sweep  = &sweep;
+  ctx.write  = remote_write;
+  sweep.index = -1;
+  fm_meter_start();
+
+  printf("%-30s %-*s %12s %10s %10s\n", "command", SHOW_MAX, "response", "latency us", "parse ns", "exec ns");
+  char line[256];
+  int lines = 0, errors = 0, timeouts = 0;
+  while (fgets(line, sizeof(line), in)) {
+    line[strcspn(line, "\r\n")] = 0;
+    const char *p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == 0 || *p == '#') continue;
+    if (strncmp(p, "WAIT", 4) == 0 && (p[4] == ' ' || p[4] == 0)) {       // Meter runs on its own
+      uint64_t until = fm_sim_now() + (uint64_t)strtoul(p + 4, NULL, 10) * (FM_TIMEBASE_HZ / 1000);
+      while (fm_sim_now() < until) loop_once();
+      continue;
+    }
+
+    answered = false;
+    exec_ns = 0;
+    uint64_t sent = fm_sim_now();
+    uint64_t t0 = host_ns();
+    fm_cmd_submit(p);                                                     // Command task: parse and queue
+    uint64_t parse_ns = host_ns() - t0;
+    while (!answered && fm_sim_now() - sent < TIMEOUT_TICKS) loop_once();
+
+    lines++;
+    double latency_us = (double)(answer_at - sent) / TICKS_PER_US;
+    if (!answered) {
+      timeouts++;
+      printf("%-30s %-*s\n", p, SHOW_MAX, "(no response)");
+      continue;
+    }
+    if (strncmp(response, "ERR", 3) == 0) errors++;
+    int shown = (int)strlen(response) > SHOW_MAX ? SHOW_MAX - 3 : SHOW_MAX;
+    printf("%-30s %-*.*s%s %12.1f %10llu %10llu\n", p, shown, shown, response, shown < SHOW_MAX ? "..." : "",
+           latency_us, (unsigned long long)parse_ns, (unsigned long long)exec_ns);
+    group_t *g = group(p);
+    if (g) {
+      g->n++;
+      g->latency_us += latency_us;
+      if (latency_us > g->latency_max_us) g->latency_max_us = latency_us;
+      g->parse_ns += parse_ns;
+      g->exec_ns += exec_ns;
+    }
+  }
+  if (in != stdin) fclose(in);
+
+  printf("\n%-20s %6s %14s %14s %10s %10s\n", "command", "lines", "latency us", "max us", "parse ns", "exec ns");
+  for (int i = 0; i < ngroups; i++) {
+    group_t *g = &groups[i];
+    printf("%-20s %6u %14.1f %14.1f %10.0f %10.0f\n", g->name, g->n, g->latency_us / g->n, g->latency_max_us,
+           g->parse_ns / g->n, g->exec_ns / g->n);
+  }
+  printf("%d lines, %d errors, %d without response\n", lines, errors, timeouts);
+  return timeouts ? 1 : 0;
+}
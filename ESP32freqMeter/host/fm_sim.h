@@ -0,0 +1,67 @@
+/* ESP32 Frequency Meter - host simulator
+
+   Discrete event stand-in for fm_hal.h: 16 bit Pulse Counters with the H_LIM
+   overflow interrupt, a one-shot gate timer with dispatch latency and jitter,
+   a rising edge capture unit, the LEDC hardware gate, and a synthetic input
+   signal per unit. A unit set up for quadrature decodes an encoder pair A / B
+   derived from its signal; a negative frequency turns the encoder backwards. The LEDC
+   oscillator can drive the signal of one unit, as with GPIO 25 wired to the
+   input.
+   Time only moves inside fm_sim_run().
+*/
+
+#ifndef FM_SIM_H
+#define FM_SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fm_hal.h"
+
+#define FM_SIM_UNITS          8                                           // PCNT units on the ESP32
+
+typedef struct {
+  double   freq_hz;                                                       // Nominal input frequency
+  double   drift_hz_s;                                                    // Linear frequency drift, Hz per second
+  double   noise_ppm;                                                     // White frequency noise per segment, rms
+  double   burst_on_s;                                                    // Burst mode: signal present ...
+  double   burst_off_s;                                                   // ... then absent. 0 = continuous
+} fm_sim_signal_t;
+
+typedef struct {
+  uint32_t timer_latency;                                                 // esp-timer dispatch latency, ticks
+  uint32_t timer_jitter;                                                  // Extra random latency 0..jitter, ticks
+  uint32_t isr_latency;                                                   // Event to ISR entry (PCNT, capture), ticks
+  uint32_t isr_jitter;                                                    // Extra random ISR latency 0..jitter, ticks
+  uint32_t now_res;                                                       // fm_hal_now() resolution, ticks
+  int32_t  cap_align;                                                     // Capture counter to timebase alignment error, ticks
+  uint32_t cap_read;                                                      // Capture ISR entry to the capture register read, ticks
+  uint32_t now_read;                                                      // Capture ISR entry to the timebase read, ticks
+  uint64_t segment;                                                       // Signal update period (drift, noise, bursts), ticks
+  uint32_t seed;                                                          // Random seed (phase, noise, jitter)
+} fm_sim_config_t;
+
+typedef struct {
+  uint64_t isr_calls;                                                     // PCNT ISR invocations
+  uint64_t isr_units;                                                     // Units serviced, summed over PCNT ISR calls
+  uint64_t isr_host_ns;                                                   // Host time inside the PCNT ISR callback
+  uint64_t timer_host_ns;                                                 // Host time inside the gate timer callback
+  uint64_t capture_calls;                                                 // Capture ISR invocations
+  uint64_t edge_calls;                                                    // Encoder edge capture interrupts
+  uint64_t timer_calls;                                                   // Gate timer callbacks
+  uint64_t gate_calls;                                                    // Hardware gate ISR invocations
+  uint64_t events;                                                        // Simulator events processed
+} fm_sim_stats_t;
+
+void     fm_sim_default_config(fm_sim_config_t *cfg);
+void     fm_sim_reset(const fm_sim_config_t *cfg);                        // Clear all state, time = 0
+void     fm_sim_set_signal(int unit, const fm_sim_signal_t *sig);
+void     fm_sim_set_encoder(int unit, double duty, double phase_deg);     // A high share, B rise after A rise (default 0.5, 90)
+void     fm_sim_run(uint64_t ticks);                                      // Advance simulated time
+bool     fm_sim_step(uint64_t until);                                     // Advance to the next event, false at until
+uint64_t fm_sim_now(void);
+double   fm_sim_phase_at(int unit, uint64_t t);                           // Input phase in cycles at time t (recent history)
+void     fm_sim_connect_ledc(int unit);                                   // LEDC output drives the unit's signal, -1 = none
+int64_t  fm_sim_position(int unit);                                       // Quadrature edges A + B, signed, since fm_hal_pcnt_quad_init
+void     fm_sim_get_stats(fm_sim_stats_t *stats);
+
+#endif // FM_SIM_H
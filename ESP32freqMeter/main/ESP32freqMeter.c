@@ -24,7 +24,7 @@
 
   GPIO_35 = Pulse Counter control input - HIGH =count up, LOW=count down
   GPIO_32 = High Resolution Timer output (to control Pulse Counter)
-  Make connection between GPIO_35 to GPIO_32 to use Frequency Meter (must have).
+  Make connection between GPIO_35 to GPIO_32 to use Frequency Meter (only with hw_gate = false).
 
   If you need, can change GPIOs pins
 
@@ -76,10 +76,43 @@
   In the frequency value, commas are inserted and printed on the serial monitor.
   The registers are reset and the input control port is set to a high level again and the pulse count starts.
 
+  Continuous mode (meter_mode = FM_MODE_CONTINUOUS):
+  The control port stays high and the pulse counter is never stopped or cleared. At every gate boundary the
+  counter value and the overflow count are snapshot into a 64 bit running total, and the frequency is the
+  difference between two consecutive snapshots over the measured time between them. There is no dead time
+  between gates, so no input pulse is lost and short gates (10 ms to 100 ms) can be used.
+  FM_MODE_GATED keeps the original stop / print / clear / restart cycle.
+
+  Reciprocal mode (meter_mode = FM_MODE_RECIPROCAL):
+  The gate opens and closes on input rising edges, timestamped by the MCPWM capture unit on the APB clock.
+  The frequency is the number of whole input periods over the time between the two edges, so the resolution
+  is 12.5 ns over the gate instead of one pulse: about 1e-6 at 10 ms and 1e-8 at 1 s, at any input frequency.
+  A slow input stretches the gate to the next edge.
+
+  Auto mode (default, meter_mode = FM_MODE_AUTO):
+  Reciprocal gates up to 20 MHz (FM_RECIP_MAX_HZ), continuous counting above it where the capture unit can no
+  longer follow the input, back to reciprocal below 18 MHz. With no input edge for 5 s it reads 0 Hz.
+
+  Autoranging (resolution_ppb, default 1 ppm):
+  After every reading the gate time is set to the shortest 1-2-5 step, 10 ms to 10 s, that meets the target
+  resolution for the measured frequency and method: 20 ms (50 readings per second) for reciprocal gates, 50 ms
+  for counting at 40 MHz. The gate narrows only with a 20 % margin, so it does not flap between two steps.
+  Inputs slower than the gate give one reading per input period. Set resolution_ppb to 0 for the fixed
+  sample_time, or resolution_mhz for an absolute target (100 = 0.1 Hz).
+
+  Multi-channel (meter_channels 2 to 8):
+  Channel 0 is GPIO 34 on PCNT unit 0, channels 1 to 7 use channel_gpio[] on units 1 to 7. All units share the
+  control input and the gate, so the readings of one gate are taken over the same time interval. Channels are
+  counted continuously (reciprocal needs the single capture unit), and each reading prints its channel number.
+
+  The hardware gate (hw_gate), text and binary output (output_mode), statistics (stats_channel), tachometer
+  (tach_ppr), LCD task (display_interval_ms), console commands, signal generator and instrumentation
+  (FM_TRACE) each have a section in ../README.md.
+
   It also has a signal oscillator that generates pulses, and can be used for testing.
   This oscillator can be configured to generate frequencies up to 40 MHz.
   We use the LEDC peripheral of ESP32 to generate frequency that can be used as a test.
-  The base frequency value is 1000 Hz, but it can be typed to another value on the serial monitor.
+  The base frequency value is 1000 Hz, but it can be typed to another value on the serial monitor (GEN <Hz>).
   The deafault duty cycle was set to 50%, and the resolution is properly calculated.
   The output port of this generator is currently defined as GPIO 25.
 
@@ -90,9 +123,26 @@
   Using LCD     =   LCD_ON or LCD_OFF
   Using LCD I2C =   LCD_I2C_ON or LCD_I2C_OFF
 
-  Calculation of adjustments for each frequency range:
-  Resolution = log2(Clock(80 MHz)/osc_freq)    ex: 50,000 Hz = 80,0000/50,000 = 1,600    log2(1600) = 10.64
-  Duty cycle 50%  = (2**Resolution)/2          ex: 2**10 = 1024      1024/2 = 512
+  Calculation of adjustments for each frequency (fm_gen.c):
+  Frequency = Clock(80 MHz) * 256 / (Divider * 2**Resolution), Divider 256 to 262143 (1.0 to 1023.996)
+  Every Resolution from 1 to 20 bits is tried with the nearest Dividers, and the one with the smallest
+  frequency error is kept, all in integers   ex: 50,000 Hz = 6 bits, Divider 25.0 (6400), exact
+  Duty cycle 50%  = (2**Resolution)/2          ex: 2**6 = 64      64/2 = 32
+  A new frequency only rewrites the timer divider (and the duty when the resolution changes).
+
+  Source files:
+  fm_core.c      = gate control and counting math, no IDF calls (also builds on Linux)
+  fm_range.c     = autoranging gate time
+  fm_ring.c      = lock free ring of finished gates, one position per consumer
+  fm_stream.c    = binary output frames
+  fm_stats.c     = running statistics and Allan deviation
+  fm_gen.c       = oscillator divider solver, retune and sweeps
+  fm_display.c   = LCD task with a shadow frame and changed characters only
+  fm_cmd.c       = command line parser and task, runs the commands in the loop
+  fm_trace.c     = timing histograms and counters of the hot path
+  fm_tach.c      = quadrature encoder position and speed
+  fm_hal_esp32.c = PCNT, esp-timer, GPIO and LEDC access used by the core
+  ../host        = Linux simulator of those peripherals and the accuracy benchmark
 
   References:
   https://github.com/espressif/esp-idf/tree/master/examples/peripherals/pcnt
@@ -109,20 +159,21 @@
 #define LCD_I2C_OFF                                                       // To use I2C LCD, set LCD_I2C_ON
 
 #include <stdio.h>                                                        // Libraries 
+#include <stdarg.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
-#include "freertos/portmacro.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
-#include "driver/periph_ctrl.h"
-#include "driver/ledc.h"
-#include "driver/gpio.h"
-#include "driver/pcnt.h"
-#include "driver/ledc.h"
-#include "esp_attr.h"
-#include "esp_log.h"
-#include "esp_timer.h"
 #include "sdkconfig.h"
 #include "math.h"
+#include "fm_core.h"                                                      // Measurement core
+#include "fm_hal.h"                                                       // Peripherals used by the core
+#include "fm_stream.h"                                                    // Binary output records
+#include "fm_stats.h"                                                     // Running statistics
+#include "fm_tach.h"                                                      // Quadrature encoder
+#include "fm_gen.h"                                                       // Oscillator settings and sweeps
+#include "fm_display.h"                                                   // LCD task
+#include "fm_cmd.h"                                                       // Remote commands
+#include "fm_trace.h"                                                     // Timing instrumentation
 
 #ifdef LCD_I2C_ON                                                         // If using I2C LCD 
 #include <LiquidCrystal_I2C.h>                                            // LCD I2C Library 
@@ -134,32 +185,45 @@ LiquidCrystal_I2C lcd(0x3F, 16, 2);                                       // Def
 LiquidCrystal lcd(5, 18, 19, 21, 22, 23);                                 // Define LCD pins at parallel interface
 #endif
 
-#define PCNT_COUNT_UNIT       PCNT_UNIT_0                                 // Set Pulse Counter Unit - 0 
-#define PCNT_COUNT_CHANNEL    PCNT_CHANNEL_0                              // Set Pulse Counter channel - 0 
-#define PCNT_INPUT_SIG_IO     GPIO_NUM_34                                 // Set Pulse Counter input - Freq Meter Input GPIO 34
-#define PCNT_INPUT_CTRL_IO    GPIO_NUM_35                                 // Set Pulse Counter Control GPIO pin - HIGH = count up, LOW = count down 
-#define OUTPUT_CONTROL_GPIO   GPIO_NUM_32                                 // Saida do timer GPIO 32 Controla a contagem
-#define IN_BOARD_LED          (gpio_num_t)2                               // ESP32 LED - GPIO 2
-#define LEDC_HS_CH0_CHANNEL   LEDC_CHANNEL_0                              // Set LEDC high speed Channel - 0
-#define LEDC_HS_MODE          LEDC_HIGH_SPEED_MODE                        // Set High speed mode
-#define LEDC_HS_TIMER         LEDC_TIMER_0                                // Set LEDC HS Timer - 0
-#define LEDC_HS_CH0_GPIO      GPIO_NUM_25                                 // Set LEDC HS_CH0 output pin - Oscillator output GPIO 25 
-
-uint32_t         overflow  =  20000;                                      // Max Pulse Counter value
-#define PCNT_H_LIM_VAL        overflow                                    // High Limit value of Pulse Counter 
-
-esp_timer_create_args_t create_args;                                      // Create an esp_timer instance
-esp_timer_handle_t timer_handle;                                          // Create an single timer
-
-bool            flag          = true;                                     // Flag to enable print frequency reading
-int16_t         pulses        = 0;                                        // Pulse Counter value
-uint32_t        multPulses    = 0;                                        // Overflows count value
+#if defined(LCD_ON) || defined(LCD_I2C_ON)                                // Either LCD: refreshed by the display task
+#define DISPLAY_ON
+#endif
+
+#define PCNT_COUNT_UNIT       0                                           // Set Pulse Counter Unit - 0 
+#define PCNT_INPUT_SIG_IO     34                                          // Set Pulse Counter input - Freq Meter Input GPIO 34
+#define PCNT_INPUT_CTRL_IO    35                                          // Set Pulse Counter Control GPIO pin - HIGH = count up, LOW = count down 
+#define OUTPUT_CONTROL_GPIO   32                                          // Saida do timer GPIO 32 Controla a contagem
+#define IN_BOARD_LED          2                                           // ESP32 LED - GPIO 2
+#define LEDC_HS_CH0_GPIO      25                                          // Set LEDC HS_CH0 output pin - Oscillator output GPIO 25 
+#define TACH_UNIT             7                                           // PCNT unit of the encoder
+#define TACH_A_GPIO           18                                          // Encoder A
+#define TACH_B_GPIO           19                                          // Encoder B
+
 uint32_t        sample_time   = 1000000;                                  // Sampling time of one second
+fm_mode_t       meter_mode    = FM_MODE_AUTO;                             // Reciprocal, counting above 20 MHz
+bool            hw_gate       = true;                                     // LEDC gate on GPIO 32 read back inside the chip, no jumper
+uint32_t        resolution_ppb = 1000;                                    // Autorange target - 1 ppm, 0 = fixed sample_time
+uint32_t        resolution_mhz = 0;                                       // Autorange target in mHz, 0 = off
+int             meter_channels = 1;                                       // Inputs measured on the common gate (1 to 8)
+int             channel_gpio[7] = { 26, 27, 14, 12, 13, 15, 4 };          // Inputs of channels 1 to 7
+#define OUTPUT_TEXT           0                                           // Console lines, as ever
+#define OUTPUT_BINARY         1                                           // fm_stream.h frames, decode with host/fm_decode
+#define STREAM_FLUSH_TICKS    (FM_TIMEBASE_HZ / 10)                       // Send a partial batch after 100 ms
+
+int             output_mode   = OUTPUT_TEXT;                              // Result output format at startup, FORMat
+fm_stream_t     stream;                                                   // Binary batch being filled
+int             stats_channel = 0;                                        // Channel summarized by fm_stats at startup, CHANnel
+fm_stats_t      stats;                                                    // Mean, deviation, drift, Allan deviation
+uint32_t        tach_ppr      = 0;                                        // Encoder pulses per revolution, 0 = no tachometer
+fm_tach_result_t tach;                                                    // Last encoder read, TACHometer?
 uint32_t        osc_freq      = 1000;                                     // Oscillator frequency - initial 1000 Hz (1 Hz to 40 Mhz)
-uint32_t        mDuty         = 0;                                        // Duty value
-uint32_t        resolution    = 0;                                        // Resolution value
-
-portMUX_TYPE timerMux = portMUX_INITIALIZER_UNLOCKED;                     // portMUX_TYPE to do synchronism
+fm_gen_setting_t gen;                                                     // Divider, resolution, duty and actual frequency
+fm_gen_sweep_t  sweep;                                                    // GENerator:SWEep: oscillator sweep self-test
+uint32_t        display_interval_ms = 200;                                // LCD refresh at most 5 times per second
+uint64_t        sweep_time    = 0;                                        // Timestamp of the last sweep step
+uint64_t        sweep_next    = 0;                                        // Step seen by sweepPoll
+bool            sweep_checked = false;                                    // Step compared with a reading
+fm_cmd_ctx_t    remote;                                                   // Console commands: channel, stream, format
 
 //----------------------------------------------------------------------------------------
 char *ultos_recursive(unsigned long val, char *s, unsigned radix, int pos) // Format an unsigned long (32 bits) into a string
@@ -191,132 +255,261 @@ char *ltos(long val, char *s, int radix)                                   // Fo
   return s;
 }
 
+//----------------------------------------------------------------------------------------
+char *ftos(double hz, double res, char *s, int width)                     // Thousands separators, decimals down to res
+{
+  int decimals = res > 0 && res < 1 ? (int)ceil(-log10(res) - 1e-9) : 0;  // Digits the reading resolves
+  if (decimals > 9) decimals = 9;
+  if (width) {                                                            // Fit the LCD row: fewer decimals
+    int len = strlen(ltos((long)(hz + 0.5), s, 10));
+    if (decimals > width - len - 1) decimals = width > len + 1 ? width - len - 1 : 0;
+  }
+  uint64_t scale = 1;
+  for (int i = 0; i < decimals; i++) scale *= 10;
+  uint64_t v = (uint64_t)llround(hz * scale);                             // Rounded once, carries into the integer part
+  ltos((long)(v / scale), s, 10);
+  if (decimals) sprintf(s + strlen(s), ".%0*llu", decimals, (unsigned long long)(v % scale));
+  return s;
+}
+
+//---------------------------------------------------------------------------------
+void consoleOut(const void *data, size_t len)                             // The one console writer: lines, frames, responses
+{
+#ifdef ARDUINO
+  Serial.write((const uint8_t *)data, len);
+#else
+  fm_hal_serial_write(data, len);                                         // UART driver, never stdio next to it
+#endif
+}
+
+//---------------------------------------------------------------------------------
+void consoleWrite(const char *text, int len, void *arg)                   // Text: LF -> CRLF, as stdio did
+{
+  static char out[128];
+  int n = 0;
+  for (int i = 0; i < len; i++) {
+    if (n > (int)sizeof(out) - 2) {                                       // Long responses (TRACe?) in pieces
+      consoleOut(out, n);
+      n = 0;
+    }
+    if (text[i] == '\n') out[n++] = '\r';
+    out[n++] = text[i];
+  }
+  if (n) consoleOut(out, n);
+}
+
+//---------------------------------------------------------------------------------
+void consolePrintf(const char *fmt, ...)                                  // One text line through consoleWrite
+{
+  char line[160];
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if (len > (int)sizeof(line) - 1) len = sizeof(line) - 1;
+  if (len > 0) consoleWrite(line, len, NULL);
+}
+
+//---------------------------------------------------------------------------------
+void streamFlush(void *arg)                                               // STReam OFF / FORMat TEXT: open batch out
+{
+  size_t len = fm_stream_finish(&stream);
+  if (len) consoleOut(stream.frame, len);
+}
+
 //----------------------------------------------------------------------------
 void ledcInit ()                                                          // Optional Pulse Oscillator to test Freq Meter
 {
-  resolution = (log(80000000 / osc_freq) / log(2)) / 2;                   // Calc of resolution divided by 2 for accuracy
-  if (resolution < 1) resolution = 1;                                     // min resolution
-  // Serial.println(resolution);
-  mDuty = (pow(2, resolution)) / 2;                                       // Calc of Duty Cycle 50% - oscillator
-  //  Serial.println(mDuty);
-
-  ledc_timer_config_t ledc_timer = {};                                    // LEDC timer config instance
-
-  ledc_timer.duty_resolution = ledc_timer_bit_t (resolution);             // Set resolution
-  ledc_timer.freq_hz    = osc_freq;                                       // Set Oscillator frequency
-  ledc_timer.speed_mode = LEDC_HIGH_SPEED_MODE;                           // Set high speed mode
-  ledc_timer.timer_num = LEDC_TIMER_0;                                    // Set LEDC timer index - 0
-  ledc_timer_config(&ledc_timer);                                         // Set LEDC Timer config
-
-  ledc_channel_config_t ledc_channel = {};                                // LEDC Channel config instance
-
-  ledc_channel.channel    = LEDC_HS_CH0_CHANNEL;                          // Set HS Channel - 0
-  ledc_channel.duty       = mDuty;                                        // Set Duty Cycle 50%
-  ledc_channel.gpio_num   = LEDC_HS_CH0_GPIO;                             // LEDC output gpio
-  ledc_channel.intr_type  = LEDC_INTR_DISABLE;                            // LEDC Fade interrupt disable
-  ledc_channel.speed_mode = LEDC_HIGH_SPEED_MODE;                         // Set LEDC high speed mode
-  ledc_channel.timer_sel  = LEDC_TIMER_0;                                 // Set timer source of channel - 0
-
-  ledc_channel_config(&ledc_channel);                                     // Config LEDC channel
+  if (!fm_gen_set((uint64_t)osc_freq * 1000, 500, &gen)) return;          // Best divider and resolution, duty 50%
+  consolePrintf("Oscillator: %.3f Hz\n", fm_gen_hz(&gen));                // Frequency actually generated
 }
 
-//----------------------------------------------------------------------------------
-void read_PCNT(void *p)                                                   // Read Pulse Counter
+//----------------------------------------------------------------------------
+void sweepPoll()                                                          // Next step when the dwell is over
 {
-  gpio_set_level(OUTPUT_CONTROL_GPIO, 0);                                 // Stop counter - output control LOW
-  pcnt_get_counter_value(PCNT_COUNT_UNIT, &pulses);                       // Read Pulse Counter value
-  flag = true;                                                            // Change flag to enable print
+  fm_gen_sweep_poll(&sweep);
+  if (sweep.index < 0 || sweep.next == sweep_next) return;                // Same step
+  sweep_next = sweep.next;                                                // Started (GENerator:SWEep) or stepped
+  sweep_time = fm_hal_now();
+  sweep_checked = false;
 }
 
-//----------------------------------------------------------------------------------
-static void IRAM_ATTR pcnt_intr_handler(void *arg)                        // Counting overflow pulses
+//----------------------------------------------------------------------------
+void sweepCheck(fm_result_t *result)                                      // First reading of a step against the oscillator
 {
-  portENTER_CRITICAL_ISR(&timerMux);                                      // disabling the interrupts
-  multPulses++;                                                           // increment Overflow counter
-  PCNT.int_clr.val = BIT(PCNT_COUNT_UNIT);                                // Clear Pulse Counter interrupt bit
-  portEXIT_CRITICAL_ISR(&timerMux);                                       // enabling the interrupts
+  if (sweep.index < 0 || sweep_checked || result->channel != 0) return;
+  if (result->gate_start < sweep_time) return;                            // Gate opened before the step
+  const fm_gen_setting_t *s = &sweep.step[sweep.index];
+  double actual = fm_gen_hz(s);
+  consolePrintf("Self-test %d: set %.3f Hz  read %.3f Hz  %+.2f ppm\n", sweep.index, actual, result->frequency,
+                (result->frequency - actual) / actual * 1e6);
+  sweep_checked = true;
 }
 
-//----------------------------------------------------------------------------------
-void pcnt_init(void)                                                      // Initialize and run PCNT unit
+#ifdef DISPLAY_ON
+//---------------------------------------------------------------------------------
+void lcdRender(const fm_result_t *result, fm_display_frame_t frame, void *arg) // Display task: reading -> characters
 {
-  pcnt_config_t pcnt_config = { };                                        // PCNT unit instance
-
-  pcnt_config.pulse_gpio_num = PCNT_INPUT_SIG_IO;                         // Pulse input GPIO 34 - Freq Meter Input
-  pcnt_config.ctrl_gpio_num = PCNT_INPUT_CTRL_IO;                         // Control signal input GPIO 35
-  pcnt_config.unit = PCNT_COUNT_UNIT;                                     // PCNT unit number - 0
-  pcnt_config.channel = PCNT_COUNT_CHANNEL;                               // PCNT channel number - 0
-  pcnt_config.counter_h_lim = PCNT_H_LIM_VAL;                             // Maximum counter value - 20000
-  pcnt_config.pos_mode = PCNT_COUNT_INC;                                  // PCNT positive edge count mode - inc
-  pcnt_config.neg_mode = PCNT_COUNT_INC;                                  // PCNT negative edge count mode - inc
-  pcnt_config.lctrl_mode = PCNT_MODE_DISABLE;                             // PCNT low control mode - disable
-  pcnt_config.hctrl_mode = PCNT_MODE_KEEP;                                // PCNT high control mode - won't change counter mode
-  pcnt_unit_config(&pcnt_config);                                         // Initialize PCNT unit
-
-  pcnt_counter_pause(PCNT_COUNT_UNIT);                                    // Pause PCNT unit
-  pcnt_counter_clear(PCNT_COUNT_UNIT);                                    // Clear PCNT unit
-
-  pcnt_event_enable(PCNT_COUNT_UNIT, PCNT_EVT_H_LIM);                     // Enable event to watch - max count
-  pcnt_isr_register(pcnt_intr_handler, NULL, 0, NULL);                    // Setup Register ISR handler
-  pcnt_intr_enable(PCNT_COUNT_UNIT);                                      // Enable interrupts for PCNT unit
-
-  pcnt_counter_resume(PCNT_COUNT_UNIT);                                   // Resume PCNT unit - starts count
+  char buf[32];                                                           // Create buffer
+  fm_display_text(frame, 0, 0, "Frequency Meter");                        // Banner, sent once
+  ftos(result->frequency, fm_range_resolution(result), buf, 12);          // Frequency to its resolution, 12 columns
+  fm_display_text(frame, 1, 1, buf);
+  fm_display_text(frame, 1, 1 + strlen(buf), " Hz");                      // Rest of the row stays blank
+}
+
+//---------------------------------------------------------------------------------
+void lcdWrite(int col, int row, const char *text, int len, void *arg)     // Display task: changed characters only
+{
+  lcd.setCursor(col, row);                                                // Set cursor position - column and row
+  lcd.write((const uint8_t *)text, len);                                  // Print
+}
+#endif
+
+//---------------------------------------------------------------------------------
+int consoleRead(char *buf, int size, void *arg)                           // Command task: bytes typed on the console
+{
+#ifdef ARDUINO
+  int n = 0;
+  while (n < size && Serial.available()) buf[n++] = (char)Serial.read();
+  if (n == 0) fm_hal_sleep_us(10000);                                     // Nothing yet, poll again in 10 ms
+  return n;
+#else
+  return fm_hal_console_read(buf, size, 10000);
+#endif
+}
+
+//---------------------------------------------------------------------------------
+void displayReading(fm_result_t *result)                                  // Latest channel 0 reading to the LCD task
+{
+#ifdef DISPLAY_ON
+  if (result->channel == 0) fm_display_publish(result);                   // Copy only, no LCD traffic here
+#endif
 }
 
 //----------------------------------------------------------------------------------
 void myInit()
 {
+  if (tach_ppr && meter_channels > TACH_UNIT)                             // Channel 7 counts on the encoder's unit
+  {
+    consolePrintf("Tachometer off: PCNT unit %d is meter channel %d\n", TACH_UNIT, TACH_UNIT);
+    tach_ppr = 0;
+  }
 #ifdef LCD_ON                                                             // If using LCD
   lcd.begin(16, 2);                                                       // LCD init
-  lcd.print("Frequency Meter");                                           // Print
+#endif
+#ifdef DISPLAY_ON
+  fm_display_config_t display_config = { 16, 2, display_interval_ms * 1000, lcdRender, lcdWrite, NULL };
+  fm_display_init(&display_config);                                       // Shadow of the cleared LCD
+  fm_display_start();                                                     // Refresh task, away from the gate loop
 #endif
 
+  fm_gen_init(LEDC_HS_CH0_GPIO);                                          // Oscillator output GPIO 25
+  sweep.index = -1;                                                       // No sweep running
   ledcInit();                                                             // Init LEDC peripheral
-  pcnt_init();                                                            // Init Pulse Counter peripheral
-  gpio_pad_select_gpio(OUTPUT_CONTROL_GPIO);                              // Set GPIO pad
-  gpio_set_direction(OUTPUT_CONTROL_GPIO, GPIO_MODE_OUTPUT);              // Set GPIO direction
 
-  create_args.callback = read_PCNT;                                       // Set esp-timer argument
-  esp_timer_create(&create_args, &timer_handle);                          // Create esp-timer instance
+  fm_config_t fm_config = { };                                            // Measurement core instance
+  fm_config.unit          = PCNT_COUNT_UNIT;                              // PCNT unit number - 0
+  fm_config.sig_gpio      = PCNT_INPUT_SIG_IO;                            // Pulse input GPIO 34 - Freq Meter Input
+  fm_config.ctrl_gpio     = PCNT_INPUT_CTRL_IO;                           // Control signal input GPIO 35
+  fm_config.out_ctrl_gpio = OUTPUT_CONTROL_GPIO;                          // Control output GPIO 32
+  fm_config.hw_gate       = hw_gate;                                      // Gate from the LEDC, GPIO 35 unused
+  fm_config.sample_time   = sample_time;                                  // Gate time - 1 second, first gate when autoranging
+  fm_config.mode          = meter_mode;                                   // Gated, continuous, reciprocal or auto
+  fm_config.range.resolution_ppb = resolution_ppb;                        // Gate time follows the input
+  fm_config.range.resolution_mhz = resolution_mhz;
+  fm_config.channels      = meter_channels;                               // Extra inputs on PCNT units 1..7
+  for (int i = 0; i < 7; i++) fm_config.ch_gpio[i] = channel_gpio[i];
+  fm_meter_init(&fm_config);                                              // Init Pulse Counter, esp-timer and control output
+  fm_stream_init(&stream);                                                // Empty binary batch
+  fm_stats_reset(&stats);                                                 // Empty statistics
+  remote.channel = stats_channel;                                         // Startup settings, then console commands
+  remote.stream  = true;
+  remote.format  = output_mode;
+  remote.stats   = &stats;
+  remote.gen     = &gen;
+  remote.sweep   = &sweep;
+  remote.tach    = tach_ppr ? &tach : NULL;
+  remote.write   = consoleWrite;
+  remote.flush   = streamFlush;
+  fm_cmd_start(consoleRead, NULL);                                        // Command task, parses away from the gate loop
+  if (tach_ppr)                                                           // Encoder on its own PCNT unit
+  {
+    fm_tach_config_t tach_config = { TACH_UNIT, TACH_A_GPIO, TACH_B_GPIO, tach_ppr };
+    fm_tach_init(&tach_config);
+  }
+  fm_meter_start();                                                       // Open the first gate
+
+  fm_hal_gpio_mirror(PCNT_INPUT_SIG_IO, IN_BOARD_LED);                    // Inboard LED flashes at the input frequency
+}
+
+//---------------------------------------------------------------------------------
+void statsReading(fm_result_t *result)                                    // Every reading goes into the statistics
+{
+  if (result->channel == remote.channel) fm_stats_add(&stats, result);
+  fm_cmd_reading(&remote, result);                                        // MEASure? waiting for this channel
+}
+
+//---------------------------------------------------------------------------------
+void tachReading(fm_result_t *result)                                     // Encoder, once per channel 0 gate
+{
+  if (!tach_ppr || result->channel != 0) return;
+  fm_tach_read(&tach);                                                    // Position now, speed since the last gate
+  if (!remote.stream || remote.format == OUTPUT_BINARY) return;           // TACHometer? only
+  if (tach.edges_valid)
+    consolePrintf("Position: %lld  RPM: %.2f  Duty: %.1f %%  Phase: %.1f deg\n", (long long)tach.position, tach.rpm,
+                  tach.duty * 100, tach.phase);
+  else consolePrintf("Position: %lld  RPM: %.2f\n", (long long)tach.position, tach.rpm);
+}
 
-  gpio_set_direction(IN_BOARD_LED, GPIO_MODE_OUTPUT);                     // Set LED inboard as output
+//---------------------------------------------------------------------------------
+void printReading(fm_result_t *result)                                    // Human readable output
+{
+  char buf[32];                                                           // Create buffer
+  ftos(result->frequency, fm_range_resolution(result), buf, 0);           // Digits the reading resolves
+  if (meter_channels > 1) consolePrintf("CH%d Frequency: %s Hz \n", result->channel, buf); // Multi-channel: which input
+  else consolePrintf("Frequency: %s Hz \n", buf);                         // One write per line
+}
 
-  gpio_matrix_in(PCNT_INPUT_SIG_IO, SIG_IN_FUNC226_IDX, false);           // Set GPIO matrin IN - Freq Meter input
-  gpio_matrix_out(IN_BOARD_LED, SIG_IN_FUNC226_IDX, false, false);        // Set GPIO matrix OUT - to inboard LED
+//---------------------------------------------------------------------------------
+void streamReading(fm_result_t *result)                                   // Binary output, see fm_stream.h
+{
+  statsReading(result);
+  displayReading(result);
+  if (!remote.stream) return;                                             // STReam OFF: MEASure? only
+  bool full = fm_stream_add(&stream, result);
+  if (full || result->ready - stream.base >= STREAM_FLUSH_TICKS || result->gate_ticks >= STREAM_FLUSH_TICKS)
+    consoleOut(stream.frame, fm_stream_finish(&stream));                  // Batch full, old, or slow readings
 }
 
 //---------------------------------------------------------------------------------
 void app_main(void)                                                       // main application
 {
 #ifndef ARDUINO                                                           // IDF
+  fm_hal_console_init();                                                  // Console UART, before anything is written
   myInit();                                                               // IDF
   while (1)                                                               // IDF
   {
 #endif
-    if (flag == true)                                                     // If count has ended
+    FM_TRACE_LOOP();                                                      // Loop pass time
+    fm_result_t result;                                                   // Finished gate
+    bool idle = true;
+    while (fm_meter_poll(&result))                                        // Every finished gate in the ring
     {
-      flag = false;                                                       // change flag to disable print
-      float frequency = 0;                                                // Clear variable frequency
-      frequency = (pulses + (multPulses * overflow)) / 2  ;               // Calculation of frequency
-      char buf[32];                                                       // Create buffer
-      printf("Frequency: %s", (ltos(frequency, buf, 10)));                // Print frequency
-      printf(" Hz \n");                                                   // Print unit
-
-#ifdef LCD_I2C_ON                                                         // LCD
-      lcd.setCursor(0, 0);                                                // Set cursor position - column and row
-      lcd.print("Frequency Meter");                                       // Print
-      lcd.setCursor(1, 1);                                                // Set cursor position - column and row
-      lcd.print((ltos(frequency, buf, 10)));                              // Print frequency
-      lcd.print(" Hz              ");                                     // Print unit
-#endif
-      multPulses = 0;                                                     // Clear overflow counter
-      // Put your function here, if you want
-      vTaskDelay(1);                                                      // delay 1 milisecond
+      idle = false;
+      if (remote.format == OUTPUT_BINARY) streamReading(&result);         // Framed records, no number formatting
+      else {
+        statsReading(&result);
+        displayReading(&result);                                          // LCD task
+        sweepCheck(&result);                                              // Oscillator self-test
+        if (remote.stream) printReading(&result);                         // Console text
+      }
+      tachReading(&result);                                               // Encoder, in either format
       // Put your function here, if you want
-      pcnt_counter_clear(PCNT_COUNT_UNIT);                                // Clear Pulse Counter
-      esp_timer_start_once(timer_handle, sample_time);                    // Initialize High resolution timer (1 sec)
-      gpio_set_level(OUTPUT_CONTROL_GPIO, 1);                             // Porta de controle habilita contagem dos pulsos
     }
+    if (!idle) fm_meter_start();                                          // Gated: clear counters, start timer and enable counting
+    fm_cmd_service(&remote);                                              // Commands parsed by the command task
+    sweepPoll();                                                          // Oscillator sweep, retune in place
+    if (idle) vTaskDelay(1);                                              // Ring empty: one tick to the other tasks
 #ifndef ARDUINO                                                           // IDF
   }                                                                       // IDF
 #endif
@@ -327,32 +520,16 @@ void app_main(void)                                                       // mai
 void setup()
 {
   Serial.begin(115200);                                                   // Init Serial Console Arduino 115200 Bps
-  myInit();                                                               // Initial setup
-#ifdef LCD_I2C_ON                                                         // LCD
+#ifdef LCD_I2C_ON                                                         // LCD, before the display task starts
   lcd.init();                                                             // Init I2C LCD
   lcd.backlight();                                                        // Set I2C LCD Backlight ON
 #endif
+  myInit();                                                               // Initial setup
 }
 
 //---------------------------------------------------------------------------------
 void loop()
 {
-  app_main();                                                             // main application
-  String inputString = "";                                                // clear temporary string
-  osc_freq = 0;                                                           // clear oscillator value
-  while (Serial.available())
-  {
-    char inChar = (char)Serial.read();                                    // Reads a byte on the console
-    inputString += inChar;                                                // Add char to string
-    if (inChar == '\n')                                                   // If new line (enter)
-    {
-      osc_freq = inputString.toInt();                                     // Converts String into integer value
-      inputString = "";                                                   // Clear string
-    }
-  }
-  if (osc_freq != 0)                                                      // If some value inputted to oscillator frequency
-  {
-    ledcInit();                                                           // reconfigure ledc function
-  }
+  app_main();                                                             // main application, console input in the command task
 }
 #endif
@@ -0,0 +1,483 @@
+/* ESP32 Frequency Meter - remote command protocol, see fm_cmd.h
+
+   The command task is the only producer of the operation queue and the
+   meter loop its only consumer; both ends move under the HAL lock, a few
+   instructions. Numbers are parsed as fixed point thousandths (mHz for a
+   frequency), no floating point and no strtod.
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "fm_cmd.h"
+#include "fm_trace.h"
+
+#define QUEUE_MASK            (FM_CMD_QUEUE - 1)
+#define NONE                  0xFF                                        // No set or no query form
+
+enum { ARG_NONE, ARG_NUM, ARG_MODE, ARG_BOOL, ARG_FORMAT };
+
+typedef struct {
+  const char *name;                                                       // Mnemonics, short form in upper case
+  uint8_t     set;                                                        // fm_cmd_code_t of the setting, NONE
+  uint8_t     query;                                                      // fm_cmd_code_t of the query, NONE
+  uint8_t     kind;                                                       // Argument type of the setting
+  uint8_t     min;                                                        // Arguments of the setting
+  uint8_t     max;
+} cmd_entry_t;
+
+static const cmd_entry_t commands[] = {
+  { "*IDN",             NONE,               FM_CMD_IDN_Q,    ARG_NONE,   0, 0 },
+  { "GATe",             FM_CMD_GATE,        FM_CMD_GATE_Q,   ARG_NUM,    1, 1 },
+  { "RESolution",       FM_CMD_RES,         FM_CMD_RES_Q,    ARG_NUM,    1, 1 },
+  { "MODE",             FM_CMD_MODE,        FM_CMD_MODE_Q,   ARG_MODE,   1, 1 },
+  { "CHANnel",          FM_CMD_CHAN,        FM_CMD_CHAN_Q,   ARG_NUM,    1, 1 },
+  { "STReam",           FM_CMD_STREAM,      FM_CMD_STREAM_Q, ARG_BOOL,   1, 1 },
+  { "FORMat",           FM_CMD_FORMAT,      FM_CMD_FORMAT_Q, ARG_FORMAT, 1, 1 },
+  { "GENerator",        FM_CMD_GEN,         FM_CMD_GEN_Q,    ARG_NUM,    1, 1 },
+  { "GENerator:SWEep",  FM_CMD_SWEEP,       NONE,            ARG_NUM,    0, 4 },
+  { "STATistics",       NONE,               FM_CMD_STATS_Q,  ARG_NONE,   0, 0 },
+  { "STATistics:ADEV",  NONE,               FM_CMD_ADEV_Q,   ARG_NONE,   0, 0 },
+  { "STATistics:RESet", FM_CMD_STATS_RESET, NONE,            ARG_NONE,   0, 0 },
+  { "TACHometer",       NONE,               FM_CMD_TACH_Q,   ARG_NONE,   0, 0 },
+  { "MEASure",          NONE,               FM_CMD_MEAS_Q,   ARG_NONE,   0, 0 },
+  { "TRACe",            NONE,               FM_CMD_TRACE_Q,  ARG_NONE,   0, 0 },
+  { "TRACe:RESet",      FM_CMD_TRACE_RESET, NONE,            ARG_NONE,   0, 0 },
+};
+
+static const char *modeNames[]   = { "GATed", "CONTinuous", "RECiprocal", "AUTO", NULL }; // fm_mode_t order
+static const char *boolNames[]   = { "OFF", "ON", NULL };
+static const char *formatNames[] = { "TEXT", "BINary", NULL };
+
+static fm_cmd_op_t       queue[FM_CMD_QUEUE];                             // Parsed operations for the loop
+static uint32_t          qHead       = 0;                                 // Pushed by the command task
+static uint32_t          qTail       = 0;                                 // Taken by the meter loop
+static fm_cmd_read_t     taskRead    = NULL;
+static void             *taskArg     = NULL;
+static char              resp[FM_CMD_RESP_MAX];                           // Response being formatted (meter loop)
+
+//----------------------------------------------------------------------------------
+static char upper(char c)
+{
+  return c >= 'a' && c <= 'z' ? (char)(c - 'a' + 'A') : c;
+}
+
+//----------------------------------------------------------------------------------
+static bool mnemonic(const char *tok, int len, const char *name, int name_len) // Short or long form, any case
+{
+  int short_len = 0;
+  while (short_len < name_len && (name[short_len] < 'a' || name[short_len] > 'z')) short_len++;
+  if (len != short_len && len != name_len) return false;
+  for (int i = 0; i < len; i++)
+    if (upper(tok[i]) != upper(name[i])) return false;
+  return true;
+}
+
+//----------------------------------------------------------------------------------
+static bool header_match(const char *hdr, int len, const char *name)      // Mnemonic by mnemonic, ':' separated
+{
+  while (1) {
+    int hl = 0, nl = 0;
+    while (hl < len && hdr[hl] != ':') hl++;
+    while (name[nl] && name[nl] != ':') nl++;
+    if (!mnemonic(hdr, hl, name, nl)) return false;
+    if (hl == len || name[nl] == 0) return hl == len && name[nl] == 0;
+    hdr += hl + 1;
+    len -= hl + 1;
+    name += nl + 1;
+  }
+}
+
+//----------------------------------------------------------------------------------
+static int keyword(const char *tok, int len, const char **names)          // Index in names, -1 if none
+{
+  for (int i = 0; names[i]; i++)
+    if (mnemonic(tok, len, names[i], (int)strlen(names[i]))) return i;
+  return -1;
+}
+
+//----------------------------------------------------------------------------------
+static bool number(const char *s, int len, int64_t *milli)                // [-]digits[.digits] -> thousandths, rounded
+{
+  int i = 0, digits = 0, decimals = 0;
+  bool neg = false;
+  int64_t v = 0;
+  if (i < len && (s[i] == '-' || s[i] == '+')) neg = s[i++] == '-';
+  for (; i < len && s[i] >= '0' && s[i] <= '9'; i++, digits++) {
+    if (digits >= 15) return false;                                       // Past 10^15: not a sensible value
+    v = v * 10 + (s[i] - '0');
+  }
+  v *= 1000;
+  if (i < len && s[i] == '.') {
+    int64_t scale = 100;
+    for (i++; i < len && s[i] >= '0' && s[i] <= '9'; i++, decimals++) {
+      if (decimals < 3) v += (s[i] - '0') * scale;
+      else if (decimals == 3 && s[i] >= '5') v++;                         // Round at the fourth decimal
+      scale /= 10;
+    }
+  }
+  if (i != len || digits + decimals == 0) return false;
+  *milli = neg ? -v : v;
+  return true;
+}
+
+//----------------------------------------------------------------------------------
+static bool parse_error(fm_cmd_op_t *op, const char *reason)
+{
+  op->code = FM_CMD_ERROR;
+  op->error = reason;
+  return true;
+}
+
+//----------------------------------------------------------------------------------
+static bool parse_args(const cmd_entry_t *e, const char *p, fm_cmd_op_t *op)
+{
+  while (*p) {
+    while (*p == ' ' || *p == '\t') p++;
+    const char *tok = p;
+    while (*p && *p != ',') p++;
+    int len = (int)(p - tok);
+    while (len > 0 && (tok[len - 1] == ' ' || tok[len - 1] == '\t')) len--;
+    if (len == 0) return false;
+    if (op->nargs == e->max) return false;
+    int64_t *a = &op->arg[op->nargs++];
+    int k = -1;
+    switch (e->kind) {
+      case ARG_NUM:    if (!number(tok, len, a)) return false; break;
+      case ARG_MODE:   k = keyword(tok, len, modeNames); break;
+      case ARG_FORMAT: k = keyword(tok, len, formatNames); break;
+      case ARG_BOOL:
+        k = keyword(tok, len, boolNames);
+        if (k < 0 && number(tok, len, a) && (*a == 0 || *a == 1000)) k = *a ? 1 : 0; // 0 / 1 as well
+        break;
+      default: return false;
+    }
+    if (e->kind != ARG_NUM) {
+      if (k < 0) return false;
+      *a = k;
+    }
+    if (*p == ',') p++;
+  }
+  return op->nargs >= e->min;
+}
+
+//----------------------------------------------------------------------------------
+bool fm_cmd_parse(const char *line, fm_cmd_op_t *op)
+{
+  memset(op, 0, sizeof(*op));
+  op->stamp = fm_hal_now();
+  const char *p = line;
+  while (*p == ' ' || *p == '\t') p++;
+  if (*p == 0) return false;                                              // Empty line, no response
+
+  const char *hdr = p;
+  while (*p && *p != ' ' && *p != '\t') p++;
+  int len = (int)(p - hdr);
+  bool query = hdr[len - 1] == '?';
+  if (query) len--;
+
+  if (!query && ((hdr[0] >= '0' && hdr[0] <= '9') || hdr[0] == '.')) {    // Bare number: oscillator frequency
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p || !number(hdr, len, &op->arg[0])) return parse_error(op, "bad number");
+    op->code = FM_CMD_GEN;
+    op->nargs = 1;
+    return true;
+  }
+
+  const cmd_entry_t *e = NULL;
+  for (unsigned i = 0; i < sizeof(commands) / sizeof(commands[0]) && !e; i++)
+    if (header_match(hdr, len, commands[i].name)) e = &commands[i];
+  if (!e) return parse_error(op, "unknown command");
+  if ((query ? e->query : e->set) == NONE) return parse_error(op, query ? "not a query" : "query only");
+  op->code = query ? e->query : e->set;
+
+  while (*p == ' ' || *p == '\t') p++;
+  if (query) {
+    if (*p) return parse_error(op, "query takes no argument");
+    return true;
+  }
+  if (!parse_args(e, p, op)) return parse_error(op, "bad argument");
+  return true;
+}
+
+//----------------------------------------------------------------------------------
+int fm_cmd_feed(fm_cmd_line_t *ln, char c)
+{
+  if (c == '\r' || c == '\n') {
+    int r = ln->overflow ? -1 : ln->len ? 1 : 0;                          // CR LF: the LF ends an empty line
+    ln->line[ln->len] = 0;
+    ln->len = 0;
+    ln->overflow = false;
+    return r;
+  }
+  if (ln->len < FM_CMD_LINE_MAX - 1) ln->line[ln->len++] = c;
+  else ln->overflow = true;
+  return 0;
+}
+
+//----------------------------------------------------------------------------------
+static void queue_push(const fm_cmd_op_t *op)                             // Command task, waits for room
+{
+  while (1) {
+    fm_hal_lock();
+    bool room = qHead - qTail < FM_CMD_QUEUE;
+    if (room) {
+      queue[qHead & QUEUE_MASK] = *op;
+      qHead++;
+    }
+    fm_hal_unlock();
+    if (room) return;
+    FM_TRACE_COUNT(FM_TRACE_CMD_WAITS, 1);
+    fm_hal_sleep_us(1000);                                                // Loop busy with a long gate
+  }
+}
+
+//----------------------------------------------------------------------------------
+void fm_cmd_submit(const char *line)
+{
+  fm_cmd_op_t op;
+  if (fm_cmd_parse(line, &op)) queue_push(&op);
+}
+
+//----------------------------------------------------------------------------------
+static void cmd_task(void *arg)                                           // Console bytes -> lines -> operations
+{
+  static fm_cmd_line_t ln;
+  char buf[32];
+  (void)arg;
+  for (;;) {
+    int n = taskRead(buf, sizeof(buf), taskArg);
+    for (int i = 0; i < n; i++) {
+      int r = fm_cmd_feed(&ln, buf[i]);
+      if (r > 0) fm_cmd_submit(ln.line);
+      else if (r < 0) {
+        fm_cmd_op_t op;
+        memset(&op, 0, sizeof(op));
+        op.stamp = fm_hal_now();
+        parse_error(&op, "line too long");
+        queue_push(&op);
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------
+void fm_cmd_start(fm_cmd_read_t read, void *arg)
+{
+  taskRead = read;
+  taskArg = arg;
+  fm_hal_task_create("fm_cmd", cmd_task, NULL, FM_CMD_STACK, FM_CMD_PRIORITY);
+}
+
+//----------------------------------------------------------------------------------
+static void reply(fm_cmd_ctx_t *ctx, const char *fmt, ...)                // One response line
+{
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(resp, sizeof(resp) - 1, fmt, ap);
+  va_end(ap);
+  if (len < 0) len = 0;
+  if (len > (int)sizeof(resp) - 2) len = sizeof(resp) - 2;
+  resp[len++] = '\n';
+  resp[len] = 0;
+  ctx->write(resp, len, ctx->arg);
+}
+
+//----------------------------------------------------------------------------------
+static void reply_adev(fm_cmd_ctx_t *ctx, const fm_stats_report_t *rep)   // tau,adev,tau,adev...
+{
+  int len = 0;
+  resp[0] = 0;
+  for (int i = 0; i < rep->taus && len < (int)sizeof(resp) - 32; i++)
+    len += snprintf(resp + len, sizeof(resp) - len, "%s%.6g,%.4e", i ? "," : "", rep->tau[i], rep->adev[i]);
+  resp[len++] = '\n';
+  resp[len] = 0;
+  ctx->write(resp, len, ctx->arg);
+}
+
+//----------------------------------------------------------------------------------
+static void execute(fm_cmd_ctx_t *ctx, const fm_cmd_op_t *op)
+{
+  static const char *modeReply[] = { "GAT", "CONT", "REC", "AUTO" };
+  fm_config_t cfg;
+  fm_stats_report_t rep;
+  int64_t a = op->arg[0];
+
+  switch (op->code) {
+    case FM_CMD_ERROR:
+      reply(ctx, "ERR %s", op->error);
+      break;
+    case FM_CMD_IDN_Q:
+      reply(ctx, "ESP32 Frequency Meter");
+      break;
+    case FM_CMD_GATE: {
+      if (a % 1000 || a < 1000 * 1000 || a > (int64_t)FM_RANGE_MAX_GATE_US * 1000) {
+        reply(ctx, "ERR gate 1000 to %u us", FM_RANGE_MAX_GATE_US);
+        break;
+      }
+      fm_meter_set_sample_time((uint32_t)(a / 1000));                     // Autorange goes on from here
+      reply(ctx, "OK");
+      break;
+    }
+    case FM_CMD_GATE_Q:
+      fm_meter_get_config(&cfg);
+      reply(ctx, "%u", cfg.sample_time);
+      break;
+    case FM_CMD_RES:
+      if (a % 1000 || a < 0 || a > 1000000000LL * 1000) {
+        reply(ctx, "ERR resolution 0 to 1000000000 ppb");
+        break;
+      }
+      fm_meter_get_config(&cfg);
+      cfg.range.resolution_ppb = (uint32_t)(a / 1000);
+      cfg.range.resolution_mhz = 0;                                       // One target, relative
+      fm_meter_set_range(&cfg.range);
+      reply(ctx, "OK");
+      break;
+    case FM_CMD_RES_Q:
+      fm_meter_get_config(&cfg);
+      reply(ctx, "%u", cfg.range.resolution_ppb);
+      break;
+    case FM_CMD_MODE:
+      fm_meter_set_mode((fm_mode_t)a);
+      reply(ctx, "OK");
+      break;
+    case FM_CMD_MODE_Q:
+      fm_meter_get_config(&cfg);
+      reply(ctx, "%s", modeReply[cfg.mode]);
+      break;
+    case FM_CMD_CHAN:
+      fm_meter_get_config(&cfg);
+      if (a % 1000 || a < 0 || a / 1000 >= (cfg.channels > 1 ? cfg.channels : 1)) {
+        reply(ctx, "ERR no such channel");
+        break;
+      }
+      ctx->channel = (int)(a / 1000);
+      fm_stats_reset(ctx->stats);                                         // Statistics follow the channel
+      reply(ctx, "OK");
+      break;
+    case FM_CMD_CHAN_Q:
+      reply(ctx, "%d", ctx->channel);
+      break;
+    case FM_CMD_STREAM:
+      if (ctx->stream && a == 0 && ctx->flush) ctx->flush(ctx->arg);      // Partial batch out before the reply
+      ctx->stream = a != 0;
+      reply(ctx, "OK");
+      break;
+    case FM_CMD_STREAM_Q:
+      reply(ctx, "%d", ctx->stream ? 1 : 0);
+      break;
+    case FM_CMD_FORMAT:
+      if (ctx->format && a == 0 && ctx->flush) ctx->flush(ctx->arg);      // Binary to text: partial batch first
+      ctx->format = (int)a;
+      reply(ctx, "OK");
+      break;
+    case FM_CMD_FORMAT_Q:
+      reply(ctx, "%s", ctx->format ? "BIN" : "TEXT");
+      break;
+    case FM_CMD_GEN:
+      if (a <= 0 || !fm_gen_set((uint64_t)a, 500, ctx->gen)) {
+        reply(ctx, "ERR frequency out of range");
+        break;
+      }
+      ctx->sweep->index = -1;                                             // A fixed frequency ends a sweep
+      reply(ctx, "%.6f", fm_gen_hz(ctx->gen));
+      break;
+    case FM_CMD_GEN_Q:
+      if (!fm_gen_get(ctx->gen)) {                                        // Sweep steps included
+        reply(ctx, "ERR oscillator off");
+        break;
+      }
+      reply(ctx, "%.6f", fm_gen_hz(ctx->gen));
+      break;
+    case FM_CMD_SWEEP: {
+      int64_t f0 = op->nargs > 0 ? op->arg[0] : 10000;                    // 10 Hz to 10 MHz, 13 steps of 3 s
+      int64_t f1 = op->nargs > 1 ? op->arg[1] : 10000000000LL;
+      int64_t n  = op->nargs > 2 ? op->arg[2] / 1000 : 13;
+      int64_t ms = op->nargs > 3 ? op->arg[3] / 1000 : 3000;
+      if (f0 <= 0 || f1 <= 0 || n < 1 || ms < 1 ||
+          fm_gen_sweep_log(ctx->sweep, (uint64_t)f0, (uint64_t)f1, (int)n, 500, (uint32_t)ms * 1000) == 0) {
+        reply(ctx, "ERR bad sweep");
+        break;
+      }
+      fm_gen_sweep_start(ctx->sweep);
+      reply(ctx, "%d", ctx->sweep->n);
+      break;
+    }
+    case FM_CMD_STATS_Q:
+      fm_stats_report(ctx->stats, &rep);
+      reply(ctx, "%llu,%.6f,%.6g,%.6f,%.6f,%.4g", (unsigned long long)rep.n, rep.mean, rep.stddev, rep.min,
+            rep.max, rep.drift);
+      break;
+    case FM_CMD_ADEV_Q:
+      fm_stats_report(ctx->stats, &rep);
+      reply_adev(ctx, &rep);
+      break;
+    case FM_CMD_STATS_RESET:
+      fm_stats_reset(ctx->stats);
+      reply(ctx, "OK");
+      break;
+    case FM_CMD_TACH_Q:
+      if (!ctx->tach) {
+        reply(ctx, "ERR no tachometer");
+        break;
+      }
+      if (ctx->tach->edges_valid)
+        reply(ctx, "%lld,%.2f,%.1f,%.1f", (long long)ctx->tach->position, ctx->tach->rpm, ctx->tach->duty * 100,
+              ctx->tach->phase);
+      else reply(ctx, "%lld,%.2f,,", (long long)ctx->tach->position, ctx->tach->rpm); // Edges too fast to capture
+      break;
+    case FM_CMD_TRACE_Q: {
+      int len = fm_trace_format(resp, sizeof(resp) - 1, ';');             // Entries on one line
+      resp[len++] = '\n';
+      resp[len] = 0;
+      ctx->write(resp, len, ctx->arg);
+      break;
+    }
+    case FM_CMD_TRACE_RESET:
+      fm_trace_reset();
+      reply(ctx, "OK");
+      break;
+    case FM_CMD_MEAS_Q: {
+      fm_meter_get_config(&cfg);
+      uint64_t wait = 3 * (uint64_t)cfg.sample_time;                      // Open gate, the next one, and its hand over
+      if (cfg.mode == FM_MODE_RECIPROCAL || cfg.mode == FM_MODE_AUTO) wait += FM_RECIP_TIMEOUT_US; // Waits for an edge
+      ctx->meas_pending = true;                                           // Answered by fm_cmd_reading
+      ctx->meas_time = fm_hal_now();
+      ctx->meas_deadline = ctx->meas_time + wait * (FM_TIMEBASE_HZ / 1000000);
+      break;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------
+int fm_cmd_service(fm_cmd_ctx_t *ctx)
+{
+  int n = 0;
+  if (ctx->meas_pending && fm_hal_now() >= ctx->meas_deadline) {          // No input in reciprocal mode, say
+    ctx->meas_pending = false;
+    reply(ctx, "ERR timeout");
+  }
+  while (!ctx->meas_pending) {                                            // Responses stay in command order
+    fm_cmd_op_t op;
+    fm_hal_lock();
+    bool any = qTail != qHead;
+    if (any) {
+      op = queue[qTail & QUEUE_MASK];
+      qTail++;
+    }
+    fm_hal_unlock();
+    if (!any) break;
+    execute(ctx, &op);
+    n++;
+  }
+  return n;
+}
+
+//----------------------------------------------------------------------------------
+void fm_cmd_reading(fm_cmd_ctx_t *ctx, const fm_result_t *res)
+{
+  if (!ctx->meas_pending || res->channel != ctx->channel || res->gate_start < ctx->meas_time) return;
+  ctx->meas_pending = false;
+  reply(ctx, "%.6f", res->frequency);
+}
@@ -0,0 +1,125 @@
+/* ESP32 Frequency Meter - remote command protocol
+
+   Line oriented, SCPI-like: a header of mnemonics joined by ':', '?' for a
+   query, arguments after a space separated by ','. Mnemonics match in their
+   short form (the upper case letters) or in full, in any case. Every line
+   gets one response line: the value for a query, OK for a setting, or
+   ERR <reason>.
+
+     *IDN?                          identification
+     GATe <us> | GATe?              gate time, the next starting point when autoranging
+     RESolution <ppb> | RESolution? autorange target, 0 = fixed gate
+     MODE GATed|CONTinuous|RECiprocal|AUTO | MODE?
+     CHANnel <n> | CHANnel?         channel of MEASure? and STATistics
+     STReam ON|OFF | STReam?        readings to the console as they come
+     FORMat TEXT|BINary | FORMat?   reading output format
+     GENerator <Hz> | GENerator?    oscillator, answers the actual frequency
+     GENerator:SWEep [f0,f1,n,ms]   oscillator log sweep (self-test)
+     STATistics? | STATistics:ADEV? | STATistics:RESet
+     TACHometer?                    last encoder read: position,rpm,duty %,phase deg
+     MEASure?                       next reading of the channel, gate opened after the command;
+                                    ERR timeout after 3 gates (+ FM_RECIP_TIMEOUT_US reciprocal)
+     TRACe? | TRACe:RESet           timing histograms and counters (fm_trace.h), ';' between entries
+     <number>                       same as GENerator <number>
+
+   No allocation anywhere: the line, the parsed operations and the response
+   live in fixed buffers. A task on the other core assembles and parses the
+   lines and queues the operations; the meter loop runs them with
+   fm_cmd_service() between gates, so parsing never delays gate handling and
+   the meter is only touched from the loop.
+*/
+
+#ifndef FM_CMD_H
+#define FM_CMD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fm_core.h"
+#include "fm_gen.h"
+#include "fm_stats.h"
+#include "fm_tach.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FM_CMD_LINE_MAX       96                                          // Characters per command line
+#define FM_CMD_ARGS           4                                           // Arguments per command
+#define FM_CMD_QUEUE          8                                           // Parsed operations waiting for the loop, power of two
+#define FM_CMD_RESP_MAX       2048                                        // Response line, TRACe? is the longest
+#define FM_CMD_STACK          3072                                        // Task stack, bytes
+#define FM_CMD_PRIORITY       1                                           // Just above idle
+
+typedef enum {
+  FM_CMD_ERROR = 0,                                                       // Parse error, answered in order
+  FM_CMD_IDN_Q,
+  FM_CMD_GATE,
+  FM_CMD_GATE_Q,
+  FM_CMD_RES,
+  FM_CMD_RES_Q,
+  FM_CMD_MODE,
+  FM_CMD_MODE_Q,
+  FM_CMD_CHAN,
+  FM_CMD_CHAN_Q,
+  FM_CMD_STREAM,
+  FM_CMD_STREAM_Q,
+  FM_CMD_FORMAT,
+  FM_CMD_FORMAT_Q,
+  FM_CMD_GEN,
+  FM_CMD_GEN_Q,
+  FM_CMD_SWEEP,
+  FM_CMD_STATS_Q,
+  FM_CMD_ADEV_Q,
+  FM_CMD_STATS_RESET,
+  FM_CMD_TACH_Q,
+  FM_CMD_MEAS_Q,
+  FM_CMD_TRACE_Q,
+  FM_CMD_TRACE_RESET,
+} fm_cmd_code_t;
+
+typedef struct {
+  uint8_t  code;                                                          // fm_cmd_code_t
+  uint8_t  nargs;
+  const char *error;                                                      // FM_CMD_ERROR: reason
+  int64_t  arg[FM_CMD_ARGS];                                              // Numbers in thousandths, keywords as their index
+  uint64_t stamp;                                                         // Line complete, ticks
+} fm_cmd_op_t;
+
+typedef int  (*fm_cmd_read_t)(char *buf, int size, void *arg);            // Command task: console bytes, may wait a little
+typedef void (*fm_cmd_write_t)(const char *text, int len, void *arg);     // Meter loop: one response line
+typedef void (*fm_cmd_flush_t)(void *arg);                                // Meter loop: readings leave binary, send the open batch
+
+typedef struct {
+  int      channel;                                                       // MEASure? and statistics channel
+  bool     stream;                                                        // Readings to the console
+  int      format;                                                        // 0 text, 1 binary (fm_stream.h)
+  fm_stats_t       *stats;                                                // Statistics of channel
+  fm_gen_setting_t *gen;                                                  // Oscillator setting
+  fm_gen_sweep_t   *sweep;                                                // Oscillator sweep
+  fm_tach_result_t *tach;                                                 // Last encoder read, NULL = no tachometer
+  fm_cmd_write_t    write;
+  fm_cmd_flush_t    flush;                                                // NULL = nothing buffered
+  void    *arg;
+  bool     meas_pending;                                                  // MEASure? waiting for a gate
+  uint64_t meas_time;                                                     // Gate must open at or after this, ticks
+  uint64_t meas_deadline;                                                 // No reading by then: ERR timeout, ticks
+} fm_cmd_ctx_t;
+
+typedef struct {
+  char     line[FM_CMD_LINE_MAX];
+  int      len;
+  bool     overflow;                                                      // Line too long, rest dropped up to its end
+} fm_cmd_line_t;
+
+int      fm_cmd_feed(fm_cmd_line_t *ln, char c);                          // Add a byte: 1 ln->line complete, -1 too long, 0 more
+bool     fm_cmd_parse(const char *line, fm_cmd_op_t *op);                 // false = empty line, op->code = FM_CMD_ERROR on errors
+void     fm_cmd_submit(const char *line);                                 // Parse and queue, waits while the queue is full
+void     fm_cmd_start(fm_cmd_read_t read, void *arg);                     // Command task (board)
+int      fm_cmd_service(fm_cmd_ctx_t *ctx);                               // Meter loop: run queued operations, count run
+void     fm_cmd_reading(fm_cmd_ctx_t *ctx, const fm_result_t *res);       // Meter loop: every reading, answers MEASure?
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FM_CMD_H
@@ -0,0 +1,513 @@
+/* ESP32 Frequency Meter - measurement core
+
+   Gated mode: the control output opens the PCNT gate, the esp-timer closes
+   it after sample_time and the counter value plus the overflows give the edges.
+   The counter is stopped and cleared between gates (dead time).
+
+   Hardware gated mode (cfg.hw_gate): the gate is an LEDC waveform on the
+   control output, read back by the PCNT control input inside the chip
+   (fm_gate.c), so both gate edges are APB clock edges and the gate length is
+   exact to the tick. The counter holds while the gate is low; a falling edge
+   interrupt only collects the counts, any time before the next gate opens.
+   Gates follow each other without software, and the gate timestamps come
+   from the waveform schedule. A reading collected after the next gate opened
+   includes edges of that gate, so it and the next one are dropped.
+
+   Continuous mode: the control output stays high and the counter is never
+   cleared. A periodic esp-timer snapshots counter + overflows into a 64 bit
+   running total; each reading is the difference of two consecutive snapshots
+   over the measured time between them, so every edge lands in exactly one gate.
+
+   Reciprocal mode: the counter runs as in continuous mode, but each gate
+   boundary is moved to the next rising input edge. The esp-timer only arms the
+   edge capture; the capture ISR gets the edge timestamp (one APB tick) and
+   reads the running total. Edges that arrive between the captured edge and the
+   counter read are removed using the edge rate, so the gate holds a whole
+   number of periods and the resolution is one tick over the gate length at
+   any input frequency.
+
+   Auto mode runs reciprocal gates, switches to continuous counting above
+   FM_RECIP_MAX_HZ, and reads 0 Hz when no edge arrives for FM_RECIP_TIMEOUT_US.
+
+   Both edges of the input are counted, so the frequency is edges / 2 / gate.
+
+   With a target in cfg.range, fm_meter_poll adapts sample_time after every
+   reading (fm_range.c).
+
+   Multi-channel: up to FM_MAX_CHANNELS PCNT units share the control input
+   and the gate timer, so all channels count over the same gate. One snapshot
+   reads every counter and the pending overflow bits at one instant, and the
+   overflow ISR accounts every unit of the status word in one pass. Channels
+   are counted (continuous or gated); reciprocal and auto apply to one channel.
+
+   Finished gates go into a ring (fm_ring.c) instead of a single result and
+   flag: fm_meter_poll and any reader from fm_meter_reader_init drain it at
+   their own pace, and records lost to a slow reader are counted, not mixed.
+*/
+
+#include <stddef.h>
+#include "fm_core.h"
+#include "fm_trace.h"
+
+#define TICKS_PER_US          (FM_TIMEBASE_HZ / 1000000)
+#define RATE_SHIFT            24                                          // Edge rate fixed point, edges per tick
+
+typedef struct {
+  int      unit;                                                          // PCNT unit
+  uint64_t snapTotal;                                                     // Running edge count at the last snapshot
+  uint32_t snapMult;                                                      // Overflows at the last snapshot
+  uint16_t snapCount;                                                     // Counter value at the last snapshot
+  uint64_t gateTotal;                                                     // Running count at gate open
+  uint32_t gateMult;                                                      // Overflows at gate open
+} channel_t;
+
+static fm_config_t       cfg;                                             // Active configuration
+static volatile uint32_t multPulses[FM_MAX_CHANNELS];                     // Overflows count value per PCNT unit (ISR)
+static channel_t         ch[FM_MAX_CHANNELS];                             // Channels on the common gate
+static int               nch         = 1;                                 // Channels in use
+static bool              running     = false;                             // Gate open (gated) or gates armed (continuous)
+static fm_mode_t         method      = FM_MODE_GATED;                     // Method of the current gate
+
+static uint64_t          gateStart   = 0;                                 // Gate open timestamp
+static uint64_t          gateDue     = 0;                                 // Requested gate close
+static uint64_t          gateLen     = 0;                                 // sample_time of the open gate, ticks
+
+static bool              hwRunning   = false;                             // Hardware gate waveform running
+static uint64_t          hwNext      = 0;                                 // Hardware gate: next fall, ticks
+static uint64_t          hwHigh      = 0;                                 // Hardware gate length, ticks
+static uint64_t          hwPeriod    = 0;                                 // Hardware gate to gate, ticks
+static int               hwSkip      = 0;                                 // Hardware gate readings still to drop
+
+static volatile bool     capArmed    = false;                             // Reciprocal: waiting for an edge
+static bool              capValid    = false;                             // Reciprocal: capTotal/capEdge hold a gate start
+static uint64_t          capTotal    = 0;                                 // Running count at the last captured edge
+static uint32_t          capMult     = 0;                                 // Overflows at the last captured edge
+static uint64_t          capEdge     = 0;                                 // Last captured edge timestamp
+static uint64_t          armTotal    = 0;                                 // Running count when the capture was armed
+static uint64_t          armTime     = 0;
+static uint64_t          armDue      = 0;                                 // Requested gate close of the armed capture
+static uint64_t          armLen      = 0;                                 // sample_time of the armed capture, ticks
+
+static fm_ring_t         ring;                                            // Finished gates, oldest overwritten
+static fm_reader_t       pollReader;                                      // fm_meter_poll position in the ring
+
+//----------------------------------------------------------------------------------
+uint64_t fm_count_total(int16_t pulses, uint32_t overflows, uint32_t h_lim)
+{
+  return (uint64_t)overflows * h_lim + (uint16_t)pulses;
+}
+
+//----------------------------------------------------------------------------------
+double fm_frequency(uint64_t edges, uint64_t ticks)
+{
+  if (ticks == 0) return 0;
+  return (double)edges * (double)FM_TIMEBASE_HZ / (2.0 * (double)ticks); // Two edges per period
+}
+
+//----------------------------------------------------------------------------------
+static void FM_IRAM overflow_isr(uint32_t status, void *arg)              // Counting overflow pulses, all units
+{
+  (void)arg;
+  while (status) {                                                        // One pass over the meter's units with an event
+    multPulses[__builtin_ctz(status)]++;                                  // increment Overflow counter
+    status &= status - 1;
+  }
+}
+
+//----------------------------------------------------------------------------------
+static uint64_t FM_IRAM snapshot(uint64_t *t)                             // Counters + overflows -> running totals
+{
+  uint16_t count[FM_MAX_CHANNELS];
+
+  fm_hal_lock();                                                          // ISRs cannot run between the reads
+  for (int i = 0; i < nch; i++) count[i] = (uint16_t)fm_hal_pcnt_get(ch[i].unit);
+  uint32_t pending = fm_hal_pcnt_overflow_pending();                      // All units in one read
+  *t = fm_hal_now();
+
+  for (int i = 0; i < nch; i++) {
+    channel_t *c = &ch[i];
+    uint32_t mult = multPulses[c->unit];
+    if ((pending & (1u << c->unit)) && count[i] < FM_PCNT_H_LIM / 2) mult++; // Counter wrapped, ISR not run yet
+    c->snapTotal += (uint64_t)(uint32_t)(mult - c->snapMult) * FM_PCNT_H_LIM + count[i] - c->snapCount;
+    c->snapMult = mult;
+    c->snapCount = count[i];
+  }
+  uint64_t total = ch[0].snapTotal;
+  fm_hal_unlock();
+  return total;
+}
+
+//----------------------------------------------------------------------------------
+static void snapshot_reset(void)                                          // Counter cleared: restart the running total
+{
+  fm_hal_lock();
+  for (int i = 0; i < nch; i++) {
+    channel_t *c = &ch[i];
+    multPulses[c->unit] = 0;                                              // Clear overflow counter
+    fm_hal_pcnt_clear(c->unit);                                           // Clear Pulse Counter
+    c->snapTotal = 0;
+    c->snapMult = 0;
+    c->snapCount = 0;
+    c->gateTotal = 0;
+    c->gateMult = 0;
+  }
+  fm_hal_unlock();
+}
+
+//----------------------------------------------------------------------------------
+static void FM_IRAM publish(const fm_result_t *r)                         // Hand a reading to the consumers
+{
+  fm_hal_lock();                                                          // Capture ISR and gate timer both publish
+  fm_ring_push(&ring, r);
+  fm_hal_unlock();
+}
+
+//----------------------------------------------------------------------------------
+static void FM_IRAM capture_gate(uint64_t edge)                           // Rising edge closes a reciprocal gate
+{
+  if (!capArmed) return;
+  capArmed = false;
+
+  uint64_t t;
+  uint64_t raw = snapshot(&t);                                            // Counter read after the edge
+  if (edge > t) edge = t;
+
+  uint64_t rate = 0;                                                      // Edges per tick << RATE_SHIFT
+  if (capValid && t > capEdge) rate = ((raw - capTotal) << RATE_SHIFT) / (t - capEdge);
+  else if (t > armTime) rate = ((raw - armTotal) << RATE_SHIFT) / (t - armTime);
+  uint64_t est = (t - edge) * rate;                                       // Edges counted after the captured one
+  uint64_t late;
+  if (capValid) {                                                         // Rising to rising edge is an even count:
+    uint64_t odd = (raw - capTotal) & 1;                                  // nearest estimate with the right parity
+    late = odd + 2 * ((est + ((1 - odd) << RATE_SHIFT)) >> (RATE_SHIFT + 1));
+  } else {
+    late = (est + (1u << (RATE_SHIFT - 1))) >> RATE_SHIFT;
+  }
+  uint64_t total = raw - (late < raw ? late : raw);
+
+  if (!capValid) {                                                        // First edge opens the gate
+    capValid = true;
+    capTotal = total;
+    capMult  = ch[0].snapMult;
+    capEdge  = edge;
+    return;
+  }
+
+  uint64_t periods = (total - capTotal + 1) / 2;                          // Whole periods between rising edges
+  fm_result_t r;
+  r.channel    = 0;
+  r.edges      = 2 * periods;
+  r.overflows  = ch[0].snapMult - capMult;
+  r.gate_start = capEdge;
+  r.gate_end   = edge;
+  r.gate_due   = armDue;
+  r.gate_ticks = edge - capEdge;
+  r.gate_nominal = armLen;                                                // Ends on an input edge, a little longer
+  r.ready      = 0;
+  r.method     = FM_MODE_RECIPROCAL;
+  r.frequency  = 0;                                                       // No floating point in the ISR, see fm_meter_poll
+  capTotal += 2 * periods;                                                // Exact count at this edge, no rounding drift
+  capMult   = ch[0].snapMult;
+  capEdge   = edge;
+  publish(&r);
+}
+
+//----------------------------------------------------------------------------------
+static void FM_IRAM capture_isr(uint64_t edge, void *arg)                 // Input edge captured
+{
+  (void)arg;
+  uint32_t t0 = FM_TRACE_STAMP();
+  FM_TRACE_HIST(FM_TRACE_CAPTURE_LAT, (uint32_t)(fm_hal_now() - edge));   // Edge to ISR entry
+  FM_TRACE_COUNT(FM_TRACE_CAPTURES, 1);
+  capture_gate(edge);
+  FM_TRACE_SPAN(FM_TRACE_CAPTURE_ISR, t0);
+}
+
+//----------------------------------------------------------------------------------
+static void auto_select(uint64_t edges, uint64_t ticks)                   // Reciprocal below FM_RECIP_MAX_HZ, 10 % hysteresis
+{
+  uint64_t rate = edges * (FM_TIMEBASE_HZ / 2);                           // frequency * ticks
+  if (method == FM_MODE_RECIPROCAL && rate > (uint64_t)FM_RECIP_MAX_HZ * ticks) {
+    method = FM_MODE_CONTINUOUS;
+    capArmed = false;
+  } else if (method == FM_MODE_CONTINUOUS && rate < (uint64_t)FM_RECIP_MAX_HZ / 10 * 9 * ticks) {
+    method = FM_MODE_RECIPROCAL;
+    capValid = false;                                                     // Next edge opens a new gate
+  }
+}
+
+//----------------------------------------------------------------------------------
+static void FM_IRAM gate_record(int i, fm_result_t *r)                    // Channel i edges since gate open, next gate opens here
+{
+  channel_t *c = &ch[i];
+  r->channel   = (uint8_t)i;
+  r->edges     = c->snapTotal - c->gateTotal;
+  r->overflows = c->snapMult - c->gateMult;
+  c->gateTotal = c->snapTotal;
+  c->gateMult  = c->snapMult;
+}
+
+//----------------------------------------------------------------------------------
+static void gate_close(void)                                              // Gate timer expired
+{
+  if (cfg.mode == FM_MODE_GATED) {
+    fm_hal_ctrl_set(0);                                                   // Stop counter - output control LOW
+    running = false;                                                      // fm_meter_start opens the next gate
+  }
+
+  uint64_t t;
+  uint64_t total = snapshot(&t);                                          // Read Pulse Counter values
+  FM_TRACE_GATE(gateDue, t);                                              // Timer dispatch against the requested end
+  fm_result_t r;
+  gate_record(0, &r);
+  r.gate_start = gateStart;
+  r.gate_end   = t;
+  r.gate_due   = gateDue;
+  r.gate_ticks = t - gateStart;                                           // Measured, the software gate runs late
+  r.gate_nominal = gateLen;                                               // A GATe command during the gate applies to the next
+  r.ready      = 0;
+  r.method     = cfg.mode == FM_MODE_GATED ? FM_MODE_GATED : FM_MODE_CONTINUOUS;
+  r.frequency  = 0;
+
+  gateStart = t;                                                          // Next gate opens at this snapshot
+  gateLen   = (uint64_t)cfg.sample_time * TICKS_PER_US;
+  gateDue  += gateLen;
+
+  if (nch > 1) {                                                          // Common gate: one record per channel
+    fm_hal_lock();
+    fm_ring_push(&ring, &r);
+    for (int i = 1; i < nch; i++) {
+      gate_record(i, &r);
+      fm_ring_push(&ring, &r);
+    }
+    fm_hal_unlock();
+    return;
+  }
+
+  if (cfg.mode == FM_MODE_AUTO) auto_select(r.edges, r.gate_ticks);
+  if (method != FM_MODE_RECIPROCAL) {
+    publish(&r);
+    return;
+  }
+
+  if (capArmed) {                                                         // No edge during this gate
+    if (cfg.mode == FM_MODE_AUTO && t - armTime >= (uint64_t)FM_RECIP_TIMEOUT_US * TICKS_PER_US) {
+      r.edges      = total - armTotal;                                    // Counting reading over the wait, 0 Hz without input
+      r.gate_start = armTime;
+      r.gate_ticks = t - armTime;
+      capValid = false;                                                   // Gate restarts at the next edge
+      armTotal = total;
+      armTime  = t;
+      publish(&r);
+    }
+    return;
+  }
+  armTotal = total;
+  armTime  = t;
+  armDue   = r.gate_due;
+  armLen   = r.gate_nominal;
+  capArmed = true;
+  fm_hal_capture_arm();                                                   // Gate closes at the next rising edge
+}
+
+//----------------------------------------------------------------------------------
+static void read_PCNT(void *p)                                            // Gate timer callback
+{
+  (void)p;
+  uint32_t t0 = FM_TRACE_STAMP();
+  gate_close();
+  FM_TRACE_SPAN(FM_TRACE_GATE_CB, t0);
+}
+
+//----------------------------------------------------------------------------------
+static void FM_IRAM gate_edge(uint64_t edge, void *arg)                   // Hardware gate output fell
+{
+  (void)arg;
+  uint32_t t0 = FM_TRACE_STAMP();
+  if (!hwRunning || edge < hwNext) return;                                // Gate stopped by software, not a gate end
+
+  uint64_t missed = (edge - hwNext) / hwPeriod;                           // Falls without an interrupt, 0 normally
+  uint64_t fall = hwNext + missed * hwPeriod;
+  hwNext = fall + hwPeriod;
+  uint64_t t;
+  snapshot(&t);                                                           // Counter held until the next gate opens
+  FM_TRACE_GATE(fall, t);                                                 // Interrupt against the gate end
+  if (missed || t >= fall + hwPeriod - hwHigh) hwSkip = 2;                // Counts of the next gate mixed in
+
+  fm_result_t r;
+  for (int i = 0; i < nch; i++) {                                         // Common gate: one record per channel
+    gate_record(i, &r);                                                   // Next gate opens at this snapshot
+    if (hwSkip) continue;
+    r.gate_start = fall - hwHigh;
+    r.gate_end   = fall;
+    r.gate_due   = fall;
+    r.gate_ticks = hwHigh;                                                // Exact, from the LEDC divider
+    r.gate_nominal = hwHigh;
+    r.ready      = 0;
+    r.method     = FM_MODE_GATED;
+    r.frequency  = 0;
+    publish(&r);
+  }
+  if (hwSkip) hwSkip--;
+  FM_TRACE_SPAN(FM_TRACE_GATE_CB, t0);
+}
+
+//----------------------------------------------------------------------------------
+static void hw_gate_start(void)                                           // Gate waveform from now, counter cleared
+{
+  fm_gate_t g;
+  fm_gate_solve((uint64_t)cfg.sample_time * TICKS_PER_US, &g);
+  uint64_t t = fm_hal_gate_start(g.div, g.res, g.duty);                   // First fall one gate after this
+  fm_hal_lock();
+  hwHigh    = g.high;
+  hwPeriod  = g.period;
+  hwSkip    = 0;
+  gateStart = t;
+  gateDue   = gateStart + g.high;
+  hwNext    = gateDue;                                                    // Earlier edges are not gate ends
+  hwRunning = true;
+  fm_hal_unlock();
+}
+
+//----------------------------------------------------------------------------------
+void fm_meter_init(const fm_config_t *config)
+{
+  cfg = *config;
+  fm_ring_init(&ring);
+  fm_ring_reader_init(&ring, &pollReader);
+  running = false;
+  capArmed = false;
+  nch = cfg.channels > 1 ? cfg.channels : 1;
+  if (nch > FM_MAX_CHANNELS) nch = FM_MAX_CHANNELS;
+  if (nch > 1 && cfg.mode != FM_MODE_GATED) cfg.mode = FM_MODE_CONTINUOUS; // One capture unit: channels are counted
+
+  fm_hal_init();                                                          // Timebase
+  uint32_t units = 0;
+  for (int i = 0; i < nch; i++) {
+    ch[i].unit = (cfg.unit + i) % FM_MAX_CHANNELS;
+    multPulses[ch[i].unit] = 0;
+    units |= 1u << ch[i].unit;
+    fm_hal_pcnt_init(ch[i].unit, i ? cfg.ch_gpio[i - 1] : cfg.sig_gpio,   // Init Pulse Counter peripheral
+                     cfg.hw_gate ? cfg.out_ctrl_gpio : cfg.ctrl_gpio, // Same control input: common gate
+                     FM_PCNT_H_LIM);
+  }
+  fm_hal_pcnt_isr_register(units, overflow_isr, NULL);                    // Overflow accounting
+  fm_hal_capture_init(cfg.sig_gpio, capture_isr, NULL);                   // Edge timestamps for reciprocal gates
+  if (cfg.hw_gate) fm_hal_gate_init(cfg.out_ctrl_gpio, gate_edge, NULL);  // LEDC gate, read back inside the chip
+  else fm_hal_ctrl_init(cfg.out_ctrl_gpio);                               // Counting control output
+  fm_hal_timer_create(read_PCNT, NULL);                                   // Gate timer
+}
+
+//----------------------------------------------------------------------------------
+void fm_meter_start(void)
+{
+  if (running) return;                                                    // Gate still open, or continuous gates
+
+  snapshot_reset();
+  running = true;
+  if (cfg.mode == FM_MODE_GATED) {
+    method = FM_MODE_GATED;
+    if (cfg.hw_gate) {                                                    // Gates run on until fm_meter_stop
+      hw_gate_start();
+      return;
+    }
+    fm_hal_timer_start_once(cfg.sample_time);                             // Initialize High resolution timer
+    gateStart = fm_hal_now();
+    gateLen = (uint64_t)cfg.sample_time * TICKS_PER_US;                   // This gate's length, whatever GATe does next
+    gateDue = gateStart + gateLen;
+    fm_hal_ctrl_set(1);                                                   // Control output enables pulse counting
+    return;
+  }
+
+  method = cfg.mode == FM_MODE_CONTINUOUS ? FM_MODE_CONTINUOUS : FM_MODE_RECIPROCAL;
+  capArmed = false;
+  capValid = false;
+  fm_hal_ctrl_set(1);                                                     // Count from now on, never stopped
+  gateStart = fm_hal_now();
+  gateLen = (uint64_t)cfg.sample_time * TICKS_PER_US;
+  gateDue = gateStart + gateLen;
+  if (method == FM_MODE_RECIPROCAL) {                                     // First edge opens the first gate
+    armTotal = 0;
+    armTime  = gateStart;
+    capArmed = true;
+    fm_hal_capture_arm();
+  }
+  fm_hal_timer_start_periodic(cfg.sample_time);                           // One snapshot per gate
+}
+
+//----------------------------------------------------------------------------------
+void fm_meter_reader_init(fm_reader_t *rd)
+{
+  fm_ring_reader_init(&ring, rd);
+}
+
+//----------------------------------------------------------------------------------
+bool fm_meter_read(fm_reader_t *rd, fm_result_t *res)
+{
+  if (!fm_ring_read(&ring, rd, res)) return false;                        // Count not ended
+  res->ready = fm_hal_now();
+  res->frequency = fm_frequency(res->edges, res->gate_ticks);             // Calculation of frequency
+  return true;
+}
+
+//----------------------------------------------------------------------------------
+bool fm_meter_poll(fm_result_t *res)
+{
+  uint32_t dropped = pollReader.dropped;
+  if (!fm_meter_read(&pollReader, res)) return false;
+  FM_TRACE_COUNT(FM_TRACE_RING_DROPS, pollReader.dropped - dropped);
+  FM_TRACE_HIST(FM_TRACE_RESULT_LAT, (uint32_t)(res->ready - res->gate_end)); // Gate end to the loop
+  FM_TRACE_HIST(FM_TRACE_OVF_GATE, res->overflows);
+
+  if (res->channel != 0) return true;                                     // Channel 0 sets the common gate
+  uint32_t gate = fm_range_select(&cfg.range, cfg.sample_time, res->frequency, res->method);
+  if (gate != cfg.sample_time) fm_meter_set_sample_time(gate);            // Autorange: next gate
+  return true;
+}
+
+//----------------------------------------------------------------------------------
+void fm_meter_stop(void)
+{
+  fm_hal_timer_stop();
+  fm_hal_lock();                                                          // A capture ISR may be on its way
+  running = false;
+  capArmed = false;
+  hwRunning = false;
+  fm_hal_unlock();
+  fm_hal_ctrl_set(0);                                                     // Stop counting
+}
+
+//----------------------------------------------------------------------------------
+void fm_meter_set_mode(fm_mode_t mode)
+{
+  fm_meter_stop();
+  cfg.mode = nch > 1 && mode != FM_MODE_GATED ? FM_MODE_CONTINUOUS : mode; // As fm_meter_init
+  fm_meter_start();
+}
+
+//----------------------------------------------------------------------------------
+void fm_meter_set_range(const fm_range_t *range)
+{
+  cfg.range = *range;
+}
+
+//----------------------------------------------------------------------------------
+void fm_meter_get_config(fm_config_t *config)
+{
+  *config = cfg;
+}
+
+//----------------------------------------------------------------------------------
+void fm_meter_set_sample_time(uint32_t us)
+{
+  cfg.sample_time = us;
+  if (hwRunning) {                                                        // New waveform, the open gate is dropped
+    fm_meter_stop();
+    fm_meter_start();
+  } else if (running && cfg.mode != FM_MODE_GATED) {                      // Restart the periodic gate
+    fm_hal_timer_stop();
+    gateLen = (uint64_t)us * TICKS_PER_US;
+    gateDue = fm_hal_now() + gateLen;
+    fm_hal_timer_start_periodic(us);
+  }
+}
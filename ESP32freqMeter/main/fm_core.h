@@ -0,0 +1,126 @@
+/* ESP32 Frequency Meter - measurement core
+
+   Gate control and counting math. No IDF calls here: peripherals are reached
+   through fm_hal.h, so the same code builds for the board and for the host
+   simulator (see host/).
+*/
+
+#ifndef FM_CORE_H
+#define FM_CORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fm_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FM_PCNT_H_LIM         20000                                       // Pulse Counter overflow limit
+#define FM_RECIP_MAX_HZ       20000000                                    // Auto: counting above, capture needs 2 APB clocks high
+#define FM_RECIP_TIMEOUT_US   5000000                                     // Auto: no edge for 5 s reads 0 Hz
+#define FM_RANGE_MIN_GATE_US  10000                                       // Autorange: default shortest gate
+#define FM_RANGE_MAX_GATE_US  10000000                                    // Autorange: default longest gate
+#define FM_RANGE_HYST_PCT     80                                          // Autorange: narrow only when the need fits 80 % of the shorter gate
+#define FM_RING_SIZE          64                                          // Records buffered per reader, power of two
+#define FM_MAX_CHANNELS       8                                           // PCNT units on the ESP32
+#define FM_GATE_MIN_LOW_US    100                                         // Hardware gate: dead time to read the counters
+#define FM_GATE_DIV_MAX       1023                                        // Hardware gate: LEDC integer divider
+#define FM_GATE_RES_MAX       20                                          // Hardware gate: LEDC timer bits
+#define FM_GATE_TOL_PPM       1000                                        // Hardware gate: off the request by this for less dead time
+
+typedef enum {
+  FM_MODE_GATED = 0,                                                      // Stop, read, clear and restart the counter each gate
+  FM_MODE_CONTINUOUS,                                                     // Free running counter, back to back gates from snapshots
+  FM_MODE_RECIPROCAL,                                                     // Gates start and stop on input edges, timed to 12.5 ns
+  FM_MODE_AUTO,                                                           // Reciprocal, continuous above FM_RECIP_MAX_HZ or without input
+} fm_mode_t;
+
+typedef struct {                                                          // Autorange targets, both 0 = fixed sample_time
+  uint32_t resolution_ppb;                                                // Relative resolution, parts per billion
+  uint32_t resolution_mhz;                                                // Absolute resolution, mHz
+  uint32_t min_gate_us;                                                   // Shortest gate, 0 = FM_RANGE_MIN_GATE_US
+  uint32_t max_gate_us;                                                   // Longest gate, 0 = FM_RANGE_MAX_GATE_US
+} fm_range_t;
+
+typedef struct {
+  int      unit;                                                          // PCNT unit
+  int      sig_gpio;                                                      // Freq Meter input
+  int      ctrl_gpio;                                                     // PCNT control input
+  int      out_ctrl_gpio;                                                 // Control output, wired to ctrl_gpio
+  bool     hw_gate;                                                       // Gated: LEDC gate on out_ctrl_gpio, read back inside the chip
+  uint32_t sample_time;                                                   // Gate time, us (first gate when autoranging)
+  fm_mode_t mode;
+  fm_range_t range;                                                       // Autorange, all 0 = off
+  int      channels;                                                      // Inputs on the common gate, 0 or 1 = sig_gpio only
+  int      ch_gpio[FM_MAX_CHANNELS - 1];                                  // Inputs of channels 1.., on units unit + 1..
+} fm_config_t;
+
+typedef struct {
+  uint8_t  channel;                                                       // Input, 0 = sig_gpio
+  uint64_t edges;                                                         // Edges counted (rise + fall)
+  uint32_t overflows;                                                     // Counter overflows during the gate
+  uint64_t gate_start;                                                    // Gate open, ticks
+  uint64_t gate_end;                                                      // Gate close, ticks
+  uint64_t gate_due;                                                      // Requested gate close, ticks
+  uint64_t gate_ticks;                                                    // Gate length used for the calculation
+  uint64_t gate_nominal;                                                  // Configured gate (sample_time) of this reading, ticks
+  uint64_t ready;                                                         // Result handed to the application, ticks
+  fm_mode_t method;                                                       // How this reading was taken
+  uint32_t seq;                                                           // Record number, consecutive from fm_meter_init
+  bool     overflow;                                                      // Records were dropped just before this one
+  double   frequency;                                                     // Hz
+} fm_result_t;
+
+typedef struct {                                                          // Hardware gate, see fm_gate.c
+  uint32_t div;                                                           // LEDC divider, 10.8 fixed point, integer
+  uint8_t  res;                                                           // LEDC timer bits
+  uint32_t duty;                                                          // High counts
+  uint64_t high;                                                          // Gate, ticks
+  uint64_t period;                                                        // Gate to gate, ticks
+} fm_gate_t;
+
+typedef struct {                                                          // Ring slot, see fm_ring.c
+  uint32_t    stamp;
+  fm_result_t rec;
+} fm_ring_slot_t;
+
+typedef struct {                                                          // Single producer ring of finished gates
+  uint32_t       head;                                                    // Records pushed
+  fm_ring_slot_t slot[FM_RING_SIZE];
+} fm_ring_t;
+
+typedef struct {                                                          // One consumer of the ring
+  uint32_t tail;                                                          // Next record to read
+  uint32_t dropped;                                                       // Records overwritten before this reader got them
+} fm_reader_t;
+
+void     fm_meter_init(const fm_config_t *cfg);                           // Configure PCNT, timer and control output
+void     fm_meter_start(void);                                            // Open a gate (continuous: first gate only)
+bool     fm_meter_poll(fm_result_t *res);                                 // True once per finished gate, drives autorange
+void     fm_meter_reader_init(fm_reader_t *rd);                           // Extra consumer, sees gates finished from now on
+bool     fm_meter_read(fm_reader_t *rd, fm_result_t *res);                // Next reading for this consumer
+void     fm_meter_set_sample_time(uint32_t us);
+void     fm_meter_stop(void);                                             // Close the gate, no readings until fm_meter_start
+void     fm_meter_set_mode(fm_mode_t mode);                               // Stop, switch, open the first gate in the new mode
+void     fm_meter_set_range(const fm_range_t *range);                     // Autorange targets from the next reading
+void     fm_meter_get_config(fm_config_t *config);                        // Active configuration, sample_time as autoranged
+
+uint64_t fm_count_total(int16_t pulses, uint32_t overflows, uint32_t h_lim); // Counter value plus overflows
+double   fm_frequency(uint64_t edges, uint64_t ticks);                    // Edges over a time span -> Hz
+
+uint32_t fm_range_needed(const fm_range_t *range, double frequency, fm_mode_t method); // Shortest gate meeting the target, us
+double   fm_range_resolution(const fm_result_t *res);                     // Resolution of a reading, Hz
+void     fm_ring_init(fm_ring_t *ring);
+void     fm_ring_push(fm_ring_t *ring, const fm_result_t *rec);           // Producer, overwrites the oldest record when full
+void     fm_ring_reader_init(const fm_ring_t *ring, fm_reader_t *rd);
+bool     fm_ring_read(const fm_ring_t *ring, fm_reader_t *rd, fm_result_t *rec); // Lock free, skips overwritten records
+
+void     fm_gate_solve(uint64_t gate_ticks, fm_gate_t *g);                // LEDC setting of the closest hardware gate
+uint32_t fm_range_select(const fm_range_t *range, uint32_t gate_us, double frequency, fm_mode_t method); // Next gate, with hysteresis
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FM_CORE_H
@@ -0,0 +1,112 @@
+/* ESP32 Frequency Meter - display task, see fm_display.h
+
+   Only the display task touches the frames and the LCD; the meter loop and
+   the task share the latest reading and its sequence number under the HAL
+   lock.
+*/
+
+#include <string.h>
+#include "fm_display.h"
+
+static fm_display_config_t cfg;                                           // Active configuration
+static fm_display_frame_t  shadow;                                        // What the LCD shows
+static fm_display_frame_t  back;                                          // Frame being rendered
+static fm_result_t         latest;                                        // Last published reading
+static uint32_t            pubSeq    = 0;                                 // Readings published
+static uint32_t            shownSeq  = 0;                                 // Reading in the shadow
+static fm_display_stats_t  stats;
+
+//----------------------------------------------------------------------------------
+static void display_task(void *arg)                                       // Refresh, then sleep out the interval
+{
+  (void)arg;
+  for (;;) {
+    uint64_t t0 = fm_hal_now();
+    fm_display_refresh();
+    uint64_t used = (fm_hal_now() - t0) / (FM_TIMEBASE_HZ / 1000000);
+    fm_hal_sleep_us(used < cfg.interval_us ? cfg.interval_us - used : 0);
+  }
+}
+
+//----------------------------------------------------------------------------------
+void fm_display_init(const fm_display_config_t *config)
+{
+  cfg = *config;
+  if (cfg.cols > FM_DISPLAY_COLS_MAX) cfg.cols = FM_DISPLAY_COLS_MAX;
+  if (cfg.rows > FM_DISPLAY_ROWS_MAX) cfg.rows = FM_DISPLAY_ROWS_MAX;
+  memset(shadow, ' ', sizeof(shadow));                                    // LCD cleared by its init
+  memset(&stats, 0, sizeof(stats));
+  pubSeq = 0;
+  shownSeq = 0;
+}
+
+//----------------------------------------------------------------------------------
+void fm_display_start(void)
+{
+  fm_hal_task_create("fm_display", display_task, NULL, FM_DISPLAY_STACK, FM_DISPLAY_PRIORITY);
+}
+
+//----------------------------------------------------------------------------------
+void fm_display_publish(const fm_result_t *res)
+{
+  fm_hal_lock();
+  latest = *res;
+  pubSeq++;
+  fm_hal_unlock();
+}
+
+//----------------------------------------------------------------------------------
+void fm_display_text(fm_display_frame_t frame, int row, int col, const char *text)
+{
+  if (row < 0 || row >= cfg.rows) return;
+  for (; *text && col < cfg.cols; col++, text++)
+    if (col >= 0) frame[row][col] = *text;
+}
+
+//----------------------------------------------------------------------------------
+int fm_display_refresh(void)
+{
+  fm_result_t res;
+  fm_hal_lock();
+  uint32_t seq = pubSeq;
+  res = latest;
+  fm_hal_unlock();
+  if (seq == shownSeq) return 0;                                          // Nothing new
+  stats.coalesced += seq - shownSeq - 1;
+  shownSeq = seq;
+
+  memset(back, ' ', sizeof(back));
+  cfg.render(&res, back, cfg.arg);
+
+  int sent = 0;
+  for (int row = 0; row < cfg.rows; row++) {
+    int col = 0;
+    while (col < cfg.cols) {
+      if (back[row][col] == shadow[row][col]) {
+        col++;
+        continue;
+      }
+      int end = col + 1;                                                  // Run of changes, bridging single gaps
+      while (end < cfg.cols) {
+        if (back[row][end] != shadow[row][end]) end++;
+        else if (end + 1 < cfg.cols && back[row][end + 1] != shadow[row][end + 1]) end += 2;
+        else break;
+      }
+      cfg.write(col, row, &back[row][col], end - col, cfg.arg);
+      memcpy(&shadow[row][col], &back[row][col], end - col);
+      sent += end - col;
+      stats.runs++;
+      col = end;
+    }
+  }
+  stats.refreshes++;
+  stats.chars += sent;
+  return sent;
+}
+
+//----------------------------------------------------------------------------------
+void fm_display_get_stats(fm_display_stats_t *st)
+{
+  *st = stats;
+  st->published = pubSeq;
+}
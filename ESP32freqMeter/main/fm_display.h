@@ -0,0 +1,65 @@
+/* ESP32 Frequency Meter - display task
+
+   Keeps the character LCD off the measurement path. The meter loop only
+   publishes its latest reading (a copy under the HAL lock, no bus traffic);
+   a low priority task on the other core renders it into a back frame at most
+   once per interval, compares it with a shadow of what the LCD shows, and
+   sends only the characters that changed: one cursor move and one write per
+   run, a single unchanged character between two changes is sent again rather
+   than paying a second cursor move. Readings published faster than the
+   interval are coalesced, the display always shows the latest one.
+
+   The LCD itself is behind the write callback, so the same code drives a
+   parallel or an I2C display, and a byte counter on the host.
+*/
+
+#ifndef FM_DISPLAY_H
+#define FM_DISPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fm_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FM_DISPLAY_COLS_MAX   20                                          // HD44780 up to 20 x 4
+#define FM_DISPLAY_ROWS_MAX   4
+#define FM_DISPLAY_STACK      3072                                        // Task stack, bytes (render formats numbers)
+#define FM_DISPLAY_PRIORITY   1                                           // Just above idle
+
+typedef char fm_display_frame_t[FM_DISPLAY_ROWS_MAX][FM_DISPLAY_COLS_MAX]; // Characters, no terminators
+
+typedef void (*fm_display_render_t)(const fm_result_t *res, fm_display_frame_t frame, void *arg); // frame is blank
+typedef void (*fm_display_write_t)(int col, int row, const char *text, int len, void *arg);      // Cursor, then text
+
+typedef struct {
+  int      cols;                                                          // Display size
+  int      rows;
+  uint32_t interval_us;                                                   // Minimum time between refreshes
+  fm_display_render_t render;                                             // Reading -> characters, display task
+  fm_display_write_t  write;                                              // Characters -> LCD, display task
+  void    *arg;
+} fm_display_config_t;
+
+typedef struct {
+  uint32_t published;                                                     // Readings handed over by the meter loop
+  uint32_t refreshes;                                                     // Frames rendered
+  uint32_t coalesced;                                                     // Readings replaced before they were shown
+  uint64_t chars;                                                         // Characters sent
+  uint64_t runs;                                                          // Cursor moves (one per write)
+} fm_display_stats_t;
+
+void     fm_display_init(const fm_display_config_t *cfg);                 // Shadow = cleared LCD
+void     fm_display_start(void);                                          // Refresh task (board)
+void     fm_display_publish(const fm_result_t *res);                      // Latest reading, never waits on the LCD
+int      fm_display_refresh(void);                                        // Render and send the changes, chars sent
+void     fm_display_text(fm_display_frame_t frame, int row, int col, const char *text); // Render helper, clipped
+void     fm_display_get_stats(fm_display_stats_t *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FM_DISPLAY_H
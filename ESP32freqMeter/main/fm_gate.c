@@ -0,0 +1,71 @@
+/* ESP32 Frequency Meter - hardware gate timing
+
+   In hardware gated mode the gate is an LEDC PWM output, so its edges come
+   from the APB clock and not from a timer callback. The LEDC timer counts
+   APB ticks divided by an integer d (the fractional divider would dither the
+   period) up to 2^res, and the output is high for the first D counts:
+
+     gate = d * D ticks,  period = d * 2^res ticks,  dead time = d * (2^res - D)
+
+   The period is a power of two counts, so an exact gate rarely fits it well:
+   the exact 1 s gate (d = 625, D = 128000, res = 17) leaves 24 ms, 2.3 %,
+   dead. The reading divides by the gate as generated, d * D, and not by the
+   request, so the gate may miss the request by up to FM_GATE_TOL_PPM. Among
+   those gates the shortest period wins, keeping the dead time close to
+   FM_GATE_MIN_LOW_US, the time left to read the counters before the next
+   gate opens:
+
+     gate    d     D        res  off by    dead       readings/s
+     10 ms   395   2025     11   156 ppm   114 us     98.9
+     100 ms  489   16360    14   5 ppm     147 us     9.985
+     1 s     611   130933   17   0.8 ppm   1.06 ms    0.9989
+
+   Short gates are bound by FM_GATE_MIN_LOW_US: 9 % dead at 1 ms. When no
+   gate is within the tolerance, the closest gate wins and then the shortest
+   period.
+
+   Gates above FM_GATE_DIV_MAX * 2^FM_GATE_RES_MAX ticks (13.4 s) are
+   clamped to it.
+*/
+
+#include "fm_core.h"
+
+#define TICKS_PER_US          (FM_TIMEBASE_HZ / 1000000)
+
+//----------------------------------------------------------------------------------
+void fm_gate_solve(uint64_t gate_ticks, fm_gate_t *g)
+{
+  uint64_t lowMin = (uint64_t)FM_GATE_MIN_LOW_US * TICKS_PER_US;
+  uint64_t tol = gate_ticks * FM_GATE_TOL_PPM / 1000000;
+  uint64_t bestMiss = UINT64_MAX;
+  bool bestIn = false;
+
+  for (uint32_t d = 1; d <= FM_GATE_DIV_MAX; d++) {
+    uint64_t duty = (gate_ticks + d / 2) / d;                             // Nearest gate with this divider
+    uint64_t low  = (lowMin + d - 1) / d;                                 // Dead time in counts, rounded up
+    if (duty == 0) duty = 1;
+    if (low == 0) low = 1;
+    if (duty + low > (1ULL << FM_GATE_RES_MAX)) {                         // Clamp to the longest gate of this divider
+      if (low >= (1ULL << FM_GATE_RES_MAX)) continue;
+      duty = (1ULL << FM_GATE_RES_MAX) - low;
+    }
+    uint32_t res = 64 - __builtin_clzll(duty + low - 1);                  // Smallest 2^res >= duty + low
+    if (res == 0) res = 1;
+    uint64_t high = duty * d;
+    uint64_t miss = high > gate_ticks ? high - gate_ticks : gate_ticks - high;
+    uint64_t period = (uint64_t)d << res;
+    bool in = miss <= tol;
+    if (bestIn && !in) continue;
+    if (in == bestIn) {
+      if (in && (period > g->period || (period == g->period && miss >= bestMiss))) continue; // Least dead time
+      if (!in && (miss > bestMiss || (miss == bestMiss && period >= g->period))) continue;   // Closest gate
+    }
+    bestIn    = in;
+    bestMiss  = miss;
+    g->div    = d << 8;
+    g->res    = (uint8_t)res;
+    g->duty   = (uint32_t)duty;
+    g->high   = high;
+    g->period = period;
+  }
+}
@@ -0,0 +1,158 @@
+/* ESP32 Frequency Meter - LEDC signal generator, see fm_gen.h
+
+   For each resolution the two dividers around FM_GEN_CLK_HZ * 256 / (f * 2^res)
+   are tried, so the solver looks at 40 candidates with 64 bit integer
+   arithmetic only: frequencies are kept in mHz, the numerator N =
+   FM_GEN_CLK_HZ * 256 * 1000 is 2.05e13 and f << 20 stays below 2^56.
+   Candidates are ranked by |N - f * period|, the period error in clock
+   steps times f: exact, and at these dividers the same order as the
+   relative frequency error, which mHz rounding hides below 100 Hz.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include "fm_gen.h"
+
+#define GEN_NUM               (FM_GEN_CLK_HZ * 256 * 1000)                // Output period numerator, mHz
+
+static int               genGpio     = -1;                                // Output GPIO
+static bool              genReady    = false;                             // Timer and channel configured
+static fm_gen_setting_t  genNow;                                          // Setting on the output
+
+//----------------------------------------------------------------------------------
+bool fm_gen_solve(uint64_t freq_mhz, uint32_t duty_permille, fm_gen_setting_t *s)
+{
+  bool found = false;
+  uint64_t best = 0;                                                      // |N - f * period| of the setting kept
+  if (freq_mhz == 0) return false;
+  if (duty_permille > 1000) duty_permille = 1000;
+
+  for (int res = FM_GEN_RES_MAX; res >= 1; res--) {                       // Finer first: an equal error keeps it
+    uint64_t den = freq_mhz << res;
+    uint64_t lo = GEN_NUM / den;
+    if (lo + 1 < FM_GEN_DIV_MIN) continue;                                // Too fast for this many bits
+    if (lo > FM_GEN_DIV_MAX) break;                                       // Too slow, and fewer bits are slower still
+    for (uint64_t div = lo; div <= lo + 1; div++) {
+      if (div < FM_GEN_DIV_MIN || div > FM_GEN_DIV_MAX) continue;
+      uint64_t period = div << res;
+      uint64_t fp = freq_mhz * period;
+      uint64_t miss = fp > GEN_NUM ? fp - GEN_NUM : GEN_NUM - fp;
+      bool better = !found || miss < best || (miss == best && (div & 0xFF) == 0 && (s->div & 0xFF) != 0);
+      if (!better) continue;
+      uint64_t actual = (GEN_NUM + period / 2) / period;
+      found = true;
+      best = miss;
+      s->div = (uint32_t)div;
+      s->res = (uint8_t)res;
+      s->duty = (uint32_t)((((uint64_t)duty_permille << res) + 500) / 1000);
+      s->freq_mhz = freq_mhz;
+      s->actual_mhz = actual;
+      s->error_mhz = (int64_t)(actual - freq_mhz);
+    }
+  }
+  return found;
+}
+
+//----------------------------------------------------------------------------------
+double fm_gen_hz(const fm_gen_setting_t *s)
+{
+  return (double)(FM_GEN_CLK_HZ << 8) / ((double)s->div * (1u << s->res));
+}
+
+//----------------------------------------------------------------------------------
+void fm_gen_init(int gpio)
+{
+  genGpio = gpio;
+  genReady = false;
+}
+
+//----------------------------------------------------------------------------------
+void fm_gen_apply(const fm_gen_setting_t *s)
+{
+  if (!genReady) {                                                        // Timer, channel and GPIO once
+    fm_hal_ledc_config(genGpio, s->div, s->res, s->duty);
+    genReady = true;
+  } else {
+    if (s->div != genNow.div || s->res != genNow.res) fm_hal_ledc_retune(s->div, s->res);
+    if (s->duty != genNow.duty) fm_hal_ledc_duty(s->duty);
+  }
+  genNow = *s;
+}
+
+//----------------------------------------------------------------------------------
+bool fm_gen_set(uint64_t freq_mhz, uint32_t duty_permille, fm_gen_setting_t *s)
+{
+  fm_gen_setting_t local;
+  if (!s) s = &local;
+  if (!fm_gen_solve(freq_mhz, duty_permille, s)) return false;
+  fm_gen_apply(s);
+  return true;
+}
+
+//----------------------------------------------------------------------------------
+bool fm_gen_get(fm_gen_setting_t *s)
+{
+  if (!genReady) return false;
+  *s = genNow;
+  return true;
+}
+
+//----------------------------------------------------------------------------------
+int fm_gen_sweep_list(fm_gen_sweep_t *sw, const uint64_t *freq_mhz, int n, uint32_t duty_permille, uint32_t dwell_us)
+{
+  sw->n = 0;
+  sw->index = -1;
+  sw->dwell_us = dwell_us;
+  sw->next = 0;
+  sw->loop = false;
+  for (int i = 0; i < n && sw->n < FM_GEN_SWEEP_MAX; i++)                 // Frequencies out of range are left out
+    if (fm_gen_solve(freq_mhz[i], duty_permille, &sw->step[sw->n])) sw->n++;
+  return sw->n;
+}
+
+//----------------------------------------------------------------------------------
+int fm_gen_sweep_log(fm_gen_sweep_t *sw, uint64_t f0_mhz, uint64_t f1_mhz, int n, uint32_t duty_permille,
+                     uint32_t dwell_us)
+{
+  uint64_t freq[FM_GEN_SWEEP_MAX];
+  if (n > FM_GEN_SWEEP_MAX) n = FM_GEN_SWEEP_MAX;
+  if (n < 1 || f0_mhz == 0 || f1_mhz == 0) n = 0;
+  double ratio = n > 1 ? exp(log((double)f1_mhz / f0_mhz) / (n - 1)) : 1; // Table build only, not per retune
+  double f = (double)f0_mhz;
+  for (int i = 0; i < n; i++, f *= ratio) freq[i] = (uint64_t)(f + 0.5);
+  if (n > 1) freq[n - 1] = f1_mhz;
+  return fm_gen_sweep_list(sw, freq, n, duty_permille, dwell_us);
+}
+
+//----------------------------------------------------------------------------------
+void fm_gen_sweep_start(fm_gen_sweep_t *sw)
+{
+  if (sw->n == 0) return;
+  sw->index = 0;
+  fm_gen_apply(&sw->step[0]);
+  sw->next = fm_hal_now() + (uint64_t)sw->dwell_us * (FM_TIMEBASE_HZ / 1000000);
+}
+
+//----------------------------------------------------------------------------------
+bool fm_gen_sweep_next(fm_gen_sweep_t *sw)
+{
+  if (sw->index < 0) return false;                                        // Not started, or finished
+  if (++sw->index >= sw->n) {
+    if (!sw->loop) {
+      sw->index = -1;
+      return false;
+    }
+    sw->index = 0;
+  }
+  fm_gen_apply(&sw->step[sw->index]);
+  return true;
+}
+
+//----------------------------------------------------------------------------------
+bool fm_gen_sweep_poll(fm_gen_sweep_t *sw)
+{
+  if (sw->index < 0 || sw->dwell_us == 0) return false;
+  if (fm_hal_now() < sw->next) return false;
+  sw->next += (uint64_t)sw->dwell_us * (FM_TIMEBASE_HZ / 1000000);        // Steps on a fixed grid, no drift
+  return fm_gen_sweep_next(sw);
+}
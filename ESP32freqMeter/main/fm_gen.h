@@ -0,0 +1,72 @@
+/* ESP32 Frequency Meter - LEDC signal generator
+
+   The LEDC high speed timer divides the 80 MHz APB clock by a 10.8 fixed
+   point divider and counts 2^res steps per output period:
+
+     f = FM_GEN_CLK_HZ * 256 / (div * 2^res),  256 <= div <= FM_GEN_DIV_MAX
+
+   fm_gen_solve() tries every resolution, with the dividers either side of
+   the ideal one, and keeps the setting with the smallest frequency error,
+   then an integer divider (no fractional dithering of the period), then the
+   finer resolution. All integer, the actual frequency rounded to mHz;
+   fm_gen_hz() gives it exactly.
+
+   Retunes only write the timer divider and resolution; the duty register is
+   rewritten only when its value changes. A sweep is a table of solved
+   settings, so stepping costs the register writes only.
+*/
+
+#ifndef FM_GEN_H
+#define FM_GEN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fm_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FM_GEN_CLK_HZ         80000000ULL                                 // LEDC high speed timer clock (APB)
+#define FM_GEN_RES_MAX        20                                          // Timer bits
+#define FM_GEN_DIV_MIN        256                                         // Divider 1.0 in 10.8 fixed point
+#define FM_GEN_DIV_MAX        0x3FFFF                                     // 1023.996
+#define FM_GEN_SWEEP_MAX      64                                          // Steps in a sweep table
+
+typedef struct {
+  uint32_t div;                                                           // Divider, 10.8 fixed point
+  uint8_t  res;                                                           // Resolution, bits
+  uint32_t duty;                                                          // High steps of 2^res
+  uint64_t freq_mhz;                                                      // Requested frequency, mHz
+  uint64_t actual_mhz;                                                    // Output frequency, mHz (rounded)
+  int64_t  error_mhz;                                                     // actual - requested
+} fm_gen_setting_t;
+
+typedef struct {
+  fm_gen_setting_t step[FM_GEN_SWEEP_MAX];
+  int      n;                                                             // Steps in the table
+  int      index;                                                         // Step on the output, -1 = not started
+  uint32_t dwell_us;                                                      // Time per step, 0 = stepped by fm_gen_sweep_next
+  uint64_t next;                                                          // Timestamp of the next step, ticks
+  bool     loop;                                                          // Start over after the last step
+} fm_gen_sweep_t;
+
+bool     fm_gen_solve(uint64_t freq_mhz, uint32_t duty_permille, fm_gen_setting_t *s); // false = out of range
+double   fm_gen_hz(const fm_gen_setting_t *s);                            // Exact output frequency, Hz
+void     fm_gen_init(int gpio);                                           // Output GPIO, configured at the first apply
+void     fm_gen_apply(const fm_gen_setting_t *s);                         // Full config once, then divider (and duty) only
+bool     fm_gen_set(uint64_t freq_mhz, uint32_t duty_permille, fm_gen_setting_t *s); // Solve and apply, s may be NULL
+bool     fm_gen_get(fm_gen_setting_t *s);                                 // Setting on the output (sweeps too), false = none
+
+int      fm_gen_sweep_list(fm_gen_sweep_t *sw, const uint64_t *freq_mhz, int n, uint32_t duty_permille, uint32_t dwell_us);
+int      fm_gen_sweep_log(fm_gen_sweep_t *sw, uint64_t f0_mhz, uint64_t f1_mhz, int n, uint32_t duty_permille,
+                          uint32_t dwell_us);                             // n log spaced steps, returns steps solved
+void     fm_gen_sweep_start(fm_gen_sweep_t *sw);                          // First step on the output now
+bool     fm_gen_sweep_poll(fm_gen_sweep_t *sw);                           // Dwell over: next step, true when stepped
+bool     fm_gen_sweep_next(fm_gen_sweep_t *sw);                           // Next step now, false after the last
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FM_GEN_H
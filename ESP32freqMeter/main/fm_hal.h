@@ -0,0 +1,99 @@
+/* ESP32 Frequency Meter - hardware layer
+
+   Thin wrapper over the peripherals used by the meter: Pulse Counter, the
+   high resolution esp-timer, the counting control GPIO or the LEDC hardware
+   gate driving it, MCPWM edge capture, the LEDC oscillator and the
+   background tasks.
+   fm_hal_esp32.c implements it on the board, host/fm_hal_sim.c simulates it on Linux.
+
+   All timestamps are in ticks of FM_TIMEBASE_HZ (80 MHz APB clock). fm_hal_now()
+   has a resolution of FM_HAL_NOW_RES ticks; edge captures resolve one tick.
+*/
+
+#ifndef FM_HAL_H
+#define FM_HAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef ESP_PLATFORM                                                       // IDF or Arduino-ESP32
+#include "esp_attr.h"
+#include "xtensa/core-macros.h"
+#define FM_IRAM               IRAM_ATTR                                   // Code called from the PCNT ISR
+#else
+#define FM_IRAM
+#endif
+
+#ifdef CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+#define FM_HAL_CYCLES_HZ      (CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000000ULL) // fm_hal_cycles() rate, CPU clock
+#else
+#define FM_HAL_CYCLES_HZ      240000000ULL
+#endif
+
+#define FM_TIMEBASE_HZ        80000000ULL                                 // Timestamp ticks per second (APB clock)
+#define FM_HAL_NOW_RES        2                                           // fm_hal_now() step: timer group clocked at APB / 2
+
+typedef void (*fm_hal_isr_t)(uint32_t status, void *arg);                 // PCNT ISR - status = bit per unit with an event
+typedef void (*fm_hal_cb_t)(void *arg);                                   // esp-timer callback
+typedef void (*fm_hal_capture_cb_t)(uint64_t edge, void *arg);            // Capture ISR - edge = rising edge timestamp
+typedef void (*fm_hal_edges_cb_t)(const uint64_t *edge, void *arg);       // Edge set: A rise, A fall, B rise, next A rise
+typedef void (*fm_hal_task_t)(void *arg);                                 // Task body, does not return
+
+#define FM_HAL_PCNT_ISRS      2                                           // PCNT ISR handlers (meter, tachometer)
+
+void     fm_hal_init(void);                                               // Timebase, call first
+
+void     fm_hal_pcnt_init(int unit, int sig_gpio, int ctrl_gpio, int16_t h_lim); // Configure unit, count both edges up to h_lim
+void     fm_hal_pcnt_quad_init(int unit, int a_gpio, int b_gpio, int16_t lim); // Quadrature x4, counts -lim..lim, both limits
+void     fm_hal_pcnt_isr_register(uint32_t units, fm_hal_isr_t isr, void *arg); // ISR for the units in the mask
+int16_t  fm_hal_pcnt_get(int unit);                                       // Read Pulse Counter value
+void     fm_hal_pcnt_clear(int unit);                                     // Clear Pulse Counter
+uint32_t fm_hal_pcnt_overflow_pending(void);                              // Bit per unit: limit reached, ISR not run yet
+int      fm_hal_pcnt_limit_dir(int unit);                                 // Last limit reached: 1 = high, -1 = low
+
+void     fm_hal_ctrl_init(int gpio);                                      // Counting control output (wired to PCNT control input)
+void     fm_hal_ctrl_set(int level);                                      // HIGH = count, LOW = stop
+void     fm_hal_gate_init(int gpio, fm_hal_capture_cb_t cb, void *arg);   // LEDC gate on gpio, read back as control input, cb at each fall
+uint64_t fm_hal_gate_start(uint32_t div, uint32_t resolution, uint32_t duty); // Periodic gate, high for duty counts, returns its start
+
+void     fm_hal_timer_create(fm_hal_cb_t cb, void *arg);                  // Create the gate esp-timer
+void     fm_hal_timer_start_once(uint64_t us);                            // Fire the gate callback once after us
+void     fm_hal_timer_start_periodic(uint64_t us);                        // Fire the gate callback every us
+void     fm_hal_timer_stop(void);
+uint64_t fm_hal_now(void);                                                // Current time, ticks
+
+void     fm_hal_capture_init(int gpio, fm_hal_capture_cb_t cb, void *arg); // Timestamp rising edges of an input
+void     fm_hal_capture_arm(void);                                        // Call cb once, at the next rising edge
+void     fm_hal_edges_init(int a_gpio, int b_gpio, fm_hal_edges_cb_t cb, void *arg); // Timestamp encoder edges
+void     fm_hal_edges_arm(void);                                          // Call cb once, after the next full A period
+
+void     fm_hal_lock(void);                                               // Critical section against the ISRs, any context
+void     fm_hal_unlock(void);
+
+void     fm_hal_ledc_config(int gpio, uint32_t div, uint32_t resolution, uint32_t duty); // Oscillator output, div 10.8 fixed point
+void     fm_hal_ledc_retune(uint32_t div, uint32_t resolution);           // New timer divider, channel and output kept
+void     fm_hal_ledc_duty(uint32_t duty);                                 // New duty, from the next period
+void     fm_hal_gpio_mirror(int in_gpio, int out_gpio);                   // Route an input to an output through the GPIO matrix
+void     fm_hal_console_init(void);                                       // Console UART driver, once before any read or write
+void     fm_hal_serial_write(const void *data, size_t len);               // Raw bytes to the console UART, one call not interleaved
+int      fm_hal_console_read(char *buf, int size, uint32_t timeout_us);   // Console UART bytes received, waits up to timeout
+
+#ifdef ESP_PLATFORM
+static inline uint32_t fm_hal_cycles(void) { return XTHAL_GET_CCOUNT(); } // CPU cycle counter of this core, any context
+#else
+uint32_t fm_hal_cycles(void);
+#endif
+
+void     fm_hal_task_create(const char *name, fm_hal_task_t fn, void *arg, uint32_t stack, int priority); // On the other core
+void     fm_hal_sleep_us(uint64_t us);                                    // Block the calling task, at least one tick
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FM_HAL_H
@@ -0,0 +1,505 @@
+/* ESP32 Frequency Meter - hardware layer, ESP32 implementation
+
+   Legacy IDF V4.x drivers (driver/pcnt.h, driver/ledc.h) as used by the original sketch.
+
+   Timebase: timer group 0 timer 0, APB / 2 = 40 MHz, free running 64 bit.
+   Edge capture: MCPWM0 capture channel 0 latches its APB counter on every rising
+   edge of the input. The capture counter is aligned to the timebase once with a
+   software capture, so captured edges and fm_hal_now() share one time line.
+   Channels 1 (encoder A, both edges) and 2 (encoder B, rising) take the encoder
+   edge sets; their interrupts are on only until a set is complete.
+   Hardware gate: LEDC high speed timer 1 / channel 1 drives the control
+   output. The pad is also an input, so the PCNT control input configured on
+   the same GPIO reads the gate through the GPIO matrix, and a GPIO falling
+   edge interrupt tells the core that a gate closed.
+*/
+
+#include "fm_hal.h"
+#include "fm_trace.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/portmacro.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "driver/pcnt.h"
+#include "driver/ledc.h"
+#include "driver/mcpwm.h"
+#include "driver/timer.h"
+#include "driver/uart.h"
+#include "soc/io_mux_reg.h"
+#include "soc/mcpwm_struct.h"
+#include "soc/timer_group_struct.h"
+#include "esp_intr_alloc.h"
+#include "esp_timer.h"
+
+#define LEDC_HS_CH0_CHANNEL   LEDC_CHANNEL_0                              // Set LEDC high speed Channel - 0
+#define LEDC_HS_TIMER         LEDC_TIMER_0                                // Set LEDC HS Timer - 0
+#define GATE_CHANNEL          LEDC_CHANNEL_1                              // Hardware gate: LEDC HS Channel - 1
+#define GATE_TIMER            LEDC_TIMER_1                                // Hardware gate: LEDC HS Timer - 1
+#define CAP0_INT_EN           BIT(27)                                     // MCPWM capture 0 interrupt bit
+#define CAP1_INT_EN           BIT(28)                                     // MCPWM capture 1 interrupt bit
+#define CAP2_INT_EN           BIT(29)                                     // MCPWM capture 2 interrupt bit
+#define PCNT_STATUS_L_LIM     BIT(4)                                      // PCNT status: last limit event was L_LIM
+
+static portMUX_TYPE       halMux      = portMUX_INITIALIZER_UNLOCKED;     // portMUX_TYPE to do synchronism
+static esp_timer_handle_t timer_handle;                                   // Gate esp-timer
+static struct {                                                           // PCNT handlers and their units
+  uint32_t     units;
+  fm_hal_isr_t fn;
+  void        *arg;
+} isrs[FM_HAL_PCNT_ISRS];
+static int                nisr        = 0;
+static gpio_num_t         ctrl_gpio   = GPIO_NUM_32;                      // Counting control output
+static fm_hal_capture_cb_t cap_fn     = NULL;                             // Core edge handler
+static void              *cap_arg     = NULL;
+static uint32_t           capOffset   = 0;                                // Timebase - capture counter, low 32 bits
+static bool               capAligned  = false;                            // capOffset measured
+static bool               mcpwmReady  = false;                            // MCPWM ISR registered
+static fm_hal_edges_cb_t  edge_fn     = NULL;                             // Encoder edge set handler
+static void              *edge_arg    = NULL;
+static uint64_t           edgeT[4];                                       // A rise, A fall, B rise, next A rise
+static uint8_t            edgeSeen    = 0;                                // Bit per edgeT entry taken
+static bool               gateOn      = false;                            // Control output driven by the LEDC gate
+static fm_hal_capture_cb_t gate_fn    = NULL;                             // Core gate close handler
+static void              *gate_arg    = NULL;
+static bool               timeReady   = false;                            // Timebase running
+
+//----------------------------------------------------------------------------------
+void fm_hal_init(void)                                                    // 64 bit timebase on timer group 0
+{
+  if (timeReady) return;                                                  // Meter and tachometer share it
+  timeReady = true;
+  timer_config_t config = { };
+  config.divider     = 2;                                                 // APB / 2 = 40 MHz, the minimum divider
+  config.counter_dir = TIMER_COUNT_UP;
+  config.counter_en  = TIMER_PAUSE;
+  config.alarm_en    = TIMER_ALARM_DIS;
+  config.auto_reload = TIMER_AUTORELOAD_DIS;
+  timer_init(TIMER_GROUP_0, TIMER_0, &config);
+  timer_set_counter_value(TIMER_GROUP_0, TIMER_0, 0);
+  timer_start(TIMER_GROUP_0, TIMER_0);
+}
+
+//----------------------------------------------------------------------------------
+static void IRAM_ATTR pcnt_intr_handler(void *arg)                        // Counting overflow pulses, all units
+{
+  uint32_t t0 = FM_TRACE_STAMP();
+  uint32_t status = PCNT.int_st.val;                                      // Units with a pending event
+  portENTER_CRITICAL_ISR(&halMux);                                        // disabling the interrupts
+  for (int i = 0; i < nisr; i++)                                          // Account the overflows
+    if (status & isrs[i].units) isrs[i].fn(status & isrs[i].units, isrs[i].arg);
+  PCNT.int_clr.val = status;                                              // Clear Pulse Counter interrupt bits
+  portEXIT_CRITICAL_ISR(&halMux);                                         // enabling the interrupts
+  FM_TRACE_COUNT(FM_TRACE_PCNT_IRQS, 1);
+  FM_TRACE_SPAN(FM_TRACE_PCNT_ISR, t0);
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_pcnt_init(int unit, int sig_gpio, int ctrl_gpio_num, int16_t h_lim)
+{
+  pcnt_config_t pcnt_config = { };                                        // PCNT unit instance
+
+  pcnt_config.pulse_gpio_num = sig_gpio;                                  // Pulse input GPIO - Freq Meter Input
+  pcnt_config.ctrl_gpio_num = ctrl_gpio_num;                              // Control signal input GPIO
+  pcnt_config.unit = (pcnt_unit_t)unit;                                   // PCNT unit number
+  pcnt_config.channel = PCNT_CHANNEL_0;                                   // PCNT channel number - 0
+  pcnt_config.counter_h_lim = h_lim;                                      // Maximum counter value
+  pcnt_config.pos_mode = PCNT_COUNT_INC;                                  // PCNT positive edge count mode - inc
+  pcnt_config.neg_mode = PCNT_COUNT_INC;                                  // PCNT negative edge count mode - inc
+  pcnt_config.lctrl_mode = PCNT_MODE_DISABLE;                             // PCNT low control mode - disable
+  pcnt_config.hctrl_mode = PCNT_MODE_KEEP;                                // PCNT high control mode - won't change counter mode
+  pcnt_unit_config(&pcnt_config);                                         // Initialize PCNT unit
+
+  pcnt_counter_pause((pcnt_unit_t)unit);                                  // Pause PCNT unit
+  pcnt_counter_clear((pcnt_unit_t)unit);                                  // Clear PCNT unit
+
+  pcnt_event_enable((pcnt_unit_t)unit, PCNT_EVT_H_LIM);                   // Enable event to watch - max count
+  pcnt_intr_enable((pcnt_unit_t)unit);                                    // Enable interrupts for PCNT unit
+
+  pcnt_counter_resume((pcnt_unit_t)unit);                                 // Resume PCNT unit - starts count
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_pcnt_quad_init(int unit, int a_gpio, int b_gpio, int16_t lim)
+{
+  pcnt_config_t pcnt_config = { };                                        // Channel 0: edges of A, direction from B
+
+  pcnt_config.pulse_gpio_num = a_gpio;
+  pcnt_config.ctrl_gpio_num = b_gpio;
+  pcnt_config.unit = (pcnt_unit_t)unit;
+  pcnt_config.channel = PCNT_CHANNEL_0;
+  pcnt_config.counter_h_lim = lim;
+  pcnt_config.counter_l_lim = -lim;
+  pcnt_config.pos_mode = PCNT_COUNT_DEC;                                  // A rises with B high: backwards
+  pcnt_config.neg_mode = PCNT_COUNT_INC;
+  pcnt_config.lctrl_mode = PCNT_MODE_REVERSE;                             // B low flips the direction
+  pcnt_config.hctrl_mode = PCNT_MODE_KEEP;
+  pcnt_unit_config(&pcnt_config);
+
+  pcnt_config.pulse_gpio_num = b_gpio;                                    // Channel 1: edges of B, direction from A
+  pcnt_config.ctrl_gpio_num = a_gpio;
+  pcnt_config.channel = PCNT_CHANNEL_1;
+  pcnt_config.pos_mode = PCNT_COUNT_INC;
+  pcnt_config.neg_mode = PCNT_COUNT_DEC;
+  pcnt_unit_config(&pcnt_config);
+
+  pcnt_counter_pause((pcnt_unit_t)unit);
+  pcnt_counter_clear((pcnt_unit_t)unit);
+  pcnt_event_enable((pcnt_unit_t)unit, PCNT_EVT_H_LIM);                   // Overflow forwards ...
+  pcnt_event_enable((pcnt_unit_t)unit, PCNT_EVT_L_LIM);                   // ... and backwards
+  pcnt_intr_enable((pcnt_unit_t)unit);
+  pcnt_counter_resume((pcnt_unit_t)unit);
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_pcnt_isr_register(uint32_t units, fm_hal_isr_t isr, void *arg)
+{
+  int i = 0;
+  while (i < nisr && isrs[i].fn != isr) i++;                              // Same handler again: new units
+  if (i == FM_HAL_PCNT_ISRS) return;
+  portENTER_CRITICAL(&halMux);
+  isrs[i].units = units;
+  isrs[i].fn = isr;
+  isrs[i].arg = arg;
+  if (i == nisr) nisr++;
+  portEXIT_CRITICAL(&halMux);
+  if (nisr == 1 && i == 0) pcnt_isr_register(pcnt_intr_handler, NULL, 0, NULL); // Setup Register ISR handler, once
+}
+
+//----------------------------------------------------------------------------------
+int16_t IRAM_ATTR fm_hal_pcnt_get(int unit)
+{
+  return (int16_t)PCNT.cnt_unit[unit].cnt_val;                            // Register read: callable from the gate ISRs
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_pcnt_clear(int unit)
+{
+  pcnt_counter_clear((pcnt_unit_t)unit);                                  // Clear Pulse Counter
+}
+
+//----------------------------------------------------------------------------------
+uint32_t IRAM_ATTR fm_hal_pcnt_overflow_pending(void)
+{
+  return PCNT.int_raw.val;                                                // Raw event bits stay set until the ISR clears them
+}
+
+//----------------------------------------------------------------------------------
+int IRAM_ATTR fm_hal_pcnt_limit_dir(int unit)
+{
+  return (PCNT.status_unit[unit].val & PCNT_STATUS_L_LIM) ? -1 : 1;
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_ctrl_init(int gpio)
+{
+  ctrl_gpio = (gpio_num_t)gpio;
+  gpio_pad_select_gpio(ctrl_gpio);                                        // Set GPIO pad
+  gpio_set_direction(ctrl_gpio, GPIO_MODE_OUTPUT);                        // Set GPIO direction
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_ctrl_set(int level)
+{
+  if (gateOn) {
+    ledc_stop(LEDC_HIGH_SPEED_MODE, GATE_CHANNEL, level);                 // Gate waveform off, output held at level
+    return;
+  }
+  gpio_set_level(ctrl_gpio, level);                                       // Control output - HIGH counts
+}
+
+//----------------------------------------------------------------------------------
+static void IRAM_ATTR gate_intr_handler(void *arg)                        // Gate output fell
+{
+  (void)arg;
+  if (gate_fn) gate_fn(fm_hal_now(), gate_arg);
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_gate_init(int gpio, fm_hal_capture_cb_t cb, void *arg)
+{
+  ctrl_gpio = (gpio_num_t)gpio;
+  gate_fn = cb;
+  gate_arg = arg;
+
+  ledc_timer_config_t ledc_timer = { };                                   // Placeholder rate, fm_hal_gate_start sets the divider
+  ledc_timer.duty_resolution = LEDC_TIMER_10_BIT;
+  ledc_timer.freq_hz    = 1000;
+  ledc_timer.speed_mode = LEDC_HIGH_SPEED_MODE;
+  ledc_timer.timer_num  = GATE_TIMER;
+  ledc_timer_config(&ledc_timer);
+
+  ledc_channel_config_t ledc_channel = { };
+  ledc_channel.channel    = GATE_CHANNEL;
+  ledc_channel.duty       = 0;
+  ledc_channel.gpio_num   = gpio;
+  ledc_channel.intr_type  = LEDC_INTR_DISABLE;
+  ledc_channel.speed_mode = LEDC_HIGH_SPEED_MODE;
+  ledc_channel.timer_sel  = GATE_TIMER;
+  ledc_channel_config(&ledc_channel);                                     // Pad output from the LEDC channel
+  ledc_stop(LEDC_HIGH_SPEED_MODE, GATE_CHANNEL, 0);                       // Gate closed until fm_hal_gate_start
+  gateOn = true;
+
+  // Order matters: ledc_channel_config sets the pad to output only, which turns its input buffer off, and
+  // gpio_set_direction(INPUT_OUTPUT) afterwards would route SIG_GPIO_OUT back onto the pad and detach the
+  // LEDC. So the input buffer is switched on directly, then the LEDC signal is routed to the pad again
+  // explicitly. The PCNT control signal was routed from this pad by fm_hal_pcnt_init.
+  PIN_INPUT_ENABLE(GPIO_PIN_MUX_REG[gpio]);                               // PCNT control reads the pad, no jumper
+  gpio_matrix_out(gpio, LEDC_HS_SIG_OUT0_IDX + GATE_CHANNEL, false, false); // Pad driven by the gate channel
+  gpio_set_intr_type(ctrl_gpio, GPIO_INTR_NEGEDGE);
+  gpio_install_isr_service(ESP_INTR_FLAG_IRAM);                           // Already installed is fine
+  gpio_isr_handler_add(ctrl_gpio, gate_intr_handler, NULL);
+}
+
+//----------------------------------------------------------------------------------
+uint64_t fm_hal_gate_start(uint32_t div, uint32_t resolution, uint32_t duty)
+{
+  ledc_timer_pause(LEDC_HIGH_SPEED_MODE, GATE_TIMER);
+  ledc_timer_set(LEDC_HIGH_SPEED_MODE, GATE_TIMER, div, resolution, LEDC_APB_CLK); // Integer divider: no period dither
+  ledc_set_duty_with_hpoint(LEDC_HIGH_SPEED_MODE, GATE_CHANNEL, duty, 0); // High from count 0 to duty
+  ledc_update_duty(LEDC_HIGH_SPEED_MODE, GATE_CHANNEL);                   // Output enabled again after ledc_stop
+  ledc_timer_rst(LEDC_HIGH_SPEED_MODE, GATE_TIMER);                       // First period starts at count 0
+  portENTER_CRITICAL(&halMux);                                            // Nothing between the start and its timestamp
+  ledc_timer_resume(LEDC_HIGH_SPEED_MODE, GATE_TIMER);                    // Gate opens
+  uint64_t t = fm_hal_now();
+  portEXIT_CRITICAL(&halMux);
+  return t;
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_timer_create(fm_hal_cb_t cb, void *arg)
+{
+  esp_timer_create_args_t create_args = { };                              // Create an esp_timer instance
+  create_args.callback = cb;                                              // Set esp-timer argument
+  create_args.arg = arg;
+  esp_timer_create(&create_args, &timer_handle);                          // Create esp-timer instance
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_timer_start_once(uint64_t us)
+{
+  esp_timer_start_once(timer_handle, us);                                 // Initialize High resolution timer
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_timer_start_periodic(uint64_t us)
+{
+  esp_timer_start_periodic(timer_handle, us);                             // Periodic gate, period does not accumulate callback latency
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_timer_stop(void)
+{
+  esp_timer_stop(timer_handle);
+}
+
+//----------------------------------------------------------------------------------
+uint64_t IRAM_ATTR fm_hal_now(void)
+{
+  TIMERG0.hw_timer[0].update = 1;                                         // Latch the counter
+  uint64_t ticks = ((uint64_t)TIMERG0.hw_timer[0].cnt_high << 32) | TIMERG0.hw_timer[0].cnt_low;
+  return ticks * FM_HAL_NOW_RES;                                          // 40 MHz -> 80 MHz ticks
+}
+
+//----------------------------------------------------------------------------------
+static inline uint64_t IRAM_ATTR capture_time(uint32_t cap, uint64_t now) // Captured counter -> timebase
+{
+  int32_t age = (int32_t)((uint32_t)now - capOffset - cap);               // Signed: capOffset is aligned to +-1 tick
+  return age > 0 ? now - (uint32_t)age : now;                             // An edge dated after now is taken as now
+}
+
+//----------------------------------------------------------------------------------
+static void IRAM_ATTR encoder_edge(uint32_t status, const uint32_t *cap, bool fall, uint64_t now) // Collect one edge set
+{
+  if (status & CAP1_INT_EN) {                                             // Encoder A
+    uint64_t t = capture_time(cap[1], now);
+    if (fall) {                                                           // Falling
+      if ((edgeSeen & 1) && !(edgeSeen & 2)) {
+        edgeT[1] = t;
+        edgeSeen |= 2;
+      }
+    } else if (!(edgeSeen & 1) || (edgeSeen & 6) != 6) {                  // Rising, set not complete: start over
+      edgeT[0] = t;
+      edgeSeen = 1;
+    } else {
+      edgeT[3] = t;
+      edgeSeen |= 8;
+    }
+  }
+  if ((status & CAP2_INT_EN) && (edgeSeen & 1) && !(edgeSeen & 4)) {      // Encoder B rising
+    edgeT[2] = capture_time(cap[2], now);
+    edgeSeen |= 4;
+  }
+  if (edgeSeen == 15) {
+    MCPWM0.int_ena.cap1_int_ena = 0;                                      // Set complete: no more edge interrupts
+    MCPWM0.int_ena.cap2_int_ena = 0;
+    if (edge_fn) edge_fn(edgeT, edge_arg);
+  }
+}
+
+//----------------------------------------------------------------------------------
+static void IRAM_ATTR capture_intr_handler(void *arg)                     // Edges captured
+{
+  uint32_t status = MCPWM0.int_st.val;
+  MCPWM0.int_clr.val = status;                                            // Clear MCPWM interrupt bits
+
+  portENTER_CRITICAL_ISR(&halMux);
+  uint32_t cap[3];                                                        // Registers first: the capture registers follow
+  for (int i = 0; i < 3; i++) cap[i] = MCPWM0.cap_val_ch[i];              // every edge, so an edge latched after now was
+  bool fall = MCPWM0.cap_status.cap1_edge;                                // read would be dated in the future
+  uint64_t now = fm_hal_now();
+  if (status & (CAP1_INT_EN | CAP2_INT_EN)) encoder_edge(status, cap, fall, now);
+  if (status & CAP0_INT_EN) {                                             // Reciprocal gate edge
+    MCPWM0.int_ena.cap0_int_ena = 0;                                      // One shot, re-armed by fm_hal_capture_arm
+    if (cap_fn) cap_fn(capture_time(cap[0], now), cap_arg);
+  }
+  portEXIT_CRITICAL_ISR(&halMux);
+}
+
+//----------------------------------------------------------------------------------
+static void capture_setup(void)                                           // Align capture counter and timebase, one ISR
+{
+  if (!capAligned) {
+    portENTER_CRITICAL(&halMux);
+    uint64_t t0 = fm_hal_now();
+    MCPWM0.cap_cfg_ch[0].sw = 1;                                          // Software capture, the counter is shared
+    uint64_t t1 = fm_hal_now();
+    capOffset = (uint32_t)((t0 + t1) / 2) - MCPWM0.cap_val_ch[0];
+    capAligned = true;
+    portEXIT_CRITICAL(&halMux);
+  }
+  if (!mcpwmReady) {
+    mcpwm_isr_register(MCPWM_UNIT_0, capture_intr_handler, NULL, ESP_INTR_FLAG_IRAM, NULL);
+    mcpwmReady = true;
+  }
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_capture_init(int gpio, fm_hal_capture_cb_t cb, void *arg)
+{
+  cap_fn = cb;
+  cap_arg = arg;
+  mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM_CAP_0, gpio);                       // Same input as the Pulse Counter
+  mcpwm_capture_enable(MCPWM_UNIT_0, MCPWM_SELECT_CAP0, MCPWM_POS_EDGE, 0); // Capture every rising edge
+  capture_setup();
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_capture_arm(void)
+{
+  MCPWM0.int_clr.val = CAP0_INT_EN;                                       // Forget edges before now
+  MCPWM0.int_ena.cap0_int_ena = 1;
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_edges_init(int a_gpio, int b_gpio, fm_hal_edges_cb_t cb, void *arg)
+{
+  edge_fn = cb;
+  edge_arg = arg;
+  mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM_CAP_1, a_gpio);                     // Same inputs as the quadrature unit
+  mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM_CAP_2, b_gpio);
+  mcpwm_capture_enable(MCPWM_UNIT_0, MCPWM_SELECT_CAP1, MCPWM_BOTH_EDGE, 0);
+  mcpwm_capture_enable(MCPWM_UNIT_0, MCPWM_SELECT_CAP2, MCPWM_POS_EDGE, 0);
+  capture_setup();
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_edges_arm(void)
+{
+  portENTER_CRITICAL(&halMux);
+  edgeSeen = 0;
+  MCPWM0.int_clr.val = CAP1_INT_EN | CAP2_INT_EN;                         // Forget edges before now
+  MCPWM0.int_ena.cap1_int_ena = 1;
+  MCPWM0.int_ena.cap2_int_ena = 1;
+  portEXIT_CRITICAL(&halMux);
+}
+
+//----------------------------------------------------------------------------------
+void IRAM_ATTR fm_hal_lock(void)
+{
+  if (xPortInIsrContext()) portENTER_CRITICAL_ISR(&halMux);
+  else portENTER_CRITICAL(&halMux);
+}
+
+void IRAM_ATTR fm_hal_unlock(void)
+{
+  if (xPortInIsrContext()) portEXIT_CRITICAL_ISR(&halMux);
+  else portEXIT_CRITICAL(&halMux);
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_ledc_config(int gpio, uint32_t div, uint32_t resolution, uint32_t duty)
+{
+  ledc_timer_config_t ledc_timer = { };                                   // LEDC timer config instance
+
+  ledc_timer.duty_resolution = (ledc_timer_bit_t)resolution;              // Set resolution
+  ledc_timer.freq_hz    = (uint32_t)((80000000ULL << 8) / ((uint64_t)div << resolution)); // Rounded down: divider >= div
+  ledc_timer.speed_mode = LEDC_HIGH_SPEED_MODE;                           // Set high speed mode
+  ledc_timer.timer_num = LEDC_HS_TIMER;                                   // Set LEDC timer index - 0
+  ledc_timer_config(&ledc_timer);                                         // Set LEDC Timer config
+  fm_hal_ledc_retune(div, resolution);                                    // Exact divider, freq_hz is rounded
+
+  ledc_channel_config_t ledc_channel = { };                               // LEDC Channel config instance
+
+  ledc_channel.channel    = LEDC_HS_CH0_CHANNEL;                          // Set HS Channel - 0
+  ledc_channel.duty       = duty;                                         // Set Duty Cycle
+  ledc_channel.gpio_num   = gpio;                                         // LEDC output gpio
+  ledc_channel.intr_type  = LEDC_INTR_DISABLE;                            // LEDC Fade interrupt disable
+  ledc_channel.speed_mode = LEDC_HIGH_SPEED_MODE;                         // Set LEDC high speed mode
+  ledc_channel.timer_sel  = LEDC_HS_TIMER;                                // Set timer source of channel - 0
+
+  ledc_channel_config(&ledc_channel);                                     // Config LEDC channel
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_ledc_retune(uint32_t div, uint32_t resolution)
+{
+  ledc_timer_set(LEDC_HIGH_SPEED_MODE, LEDC_HS_TIMER, div, resolution, LEDC_APB_CLK); // Divider registers, no timer reset
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_ledc_duty(uint32_t duty)
+{
+  ledc_set_duty(LEDC_HIGH_SPEED_MODE, LEDC_HS_CH0_CHANNEL, duty);
+  ledc_update_duty(LEDC_HIGH_SPEED_MODE, LEDC_HS_CH0_CHANNEL);            // Latched at the end of the period
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_gpio_mirror(int in_gpio, int out_gpio)
+{
+  gpio_set_direction((gpio_num_t)out_gpio, GPIO_MODE_OUTPUT);             // Set output GPIO
+  gpio_matrix_in(in_gpio, SIG_IN_FUNC226_IDX, false);                     // Set GPIO matrix IN
+  gpio_matrix_out(out_gpio, SIG_IN_FUNC226_IDX, false, false);            // Set GPIO matrix OUT
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_console_init(void)
+{
+  uart_driver_install(UART_NUM_0, 256, 4096, 0, NULL, 0);                 // TX ring: the loop does not wait for the line
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_serial_write(const void *data, size_t len)
+{
+  uart_write_bytes(UART_NUM_0, (const char *)data, len);                  // Under the driver's TX lock: whole call in order
+}
+
+//----------------------------------------------------------------------------------
+int fm_hal_console_read(char *buf, int size, uint32_t timeout_us)
+{
+  TickType_t ticks = pdMS_TO_TICKS(timeout_us / 1000);
+  int n = uart_read_bytes(UART_NUM_0, (uint8_t *)buf, size, ticks ? ticks : 1); // Whatever arrived, up to size
+  return n > 0 ? n : 0;
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_task_create(const char *name, fm_hal_task_t fn, void *arg, uint32_t stack, int priority)
+{
+  xTaskCreatePinnedToCore(fn, name, stack, arg, priority, NULL, xPortGetCoreID() ? 0 : 1); // Away from the meter loop
+}
+
+//----------------------------------------------------------------------------------
+void fm_hal_sleep_us(uint64_t us)
+{
+  TickType_t ticks = pdMS_TO_TICKS(us / 1000);
+  vTaskDelay(ticks ? ticks : 1);
+}
@@ -0,0 +1,90 @@
+/* ESP32 Frequency Meter - autoranging gate time
+
+   Picks the shortest gate that meets a target resolution, relative (ppb) or
+   absolute (mHz), from the last reading and the method that took it:
+
+     counting     one edge in 2 * f * T edges, plus FM_HAL_NOW_RES ticks of
+                  snapshot time:  res = 0.5 / (f * T) + FM_HAL_NOW_RES / (TB * T)
+     reciprocal   one timebase tick over the gate:  res = 1 / (TB * T)
+
+   so T = K / res with K fixed by the method and the input frequency. When both
+   targets are set the tighter one wins.
+
+   Gates come from a 1-2-5 ladder clamped to [min_gate_us, max_gate_us], which
+   keeps the update rate predictable. The gate widens as soon as the target is
+   missed and narrows only when the target is met with FM_RANGE_HYST_PCT of the
+   shorter gate, so a reading close to a step does not flap between two gates.
+
+   Slow inputs: a counting gate grows up to max_gate_us and the resolution
+   is what that gate gives. A reciprocal gate never ends before the next input
+   edge, so below 1 / gate each reading spans one input period and the update
+   rate is the input frequency.
+*/
+
+#include <stddef.h>
+#include "fm_core.h"
+
+static const uint32_t ladder[] = {                                        // Gate steps, us
+  1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,
+  1000000, 2000000, 5000000, 10000000, 20000000, 50000000, 100000000
+};
+#define LADDER_SIZE           (sizeof(ladder) / sizeof(ladder[0]))
+
+//----------------------------------------------------------------------------------
+static uint32_t ladder_ceil(double us, uint32_t lo, uint32_t hi)          // Smallest step >= us, within [lo, hi]
+{
+  for (size_t i = 0; i < LADDER_SIZE; i++) {
+    if (ladder[i] < lo) continue;
+    if (ladder[i] >= hi) break;
+    if (ladder[i] >= us) return ladder[i];
+  }
+  return hi;
+}
+
+//----------------------------------------------------------------------------------
+uint32_t fm_range_needed(const fm_range_t *range, double frequency, fm_mode_t method)
+{
+  if (frequency <= 0) return 0;                                           // No input, nothing to resolve
+
+  double target = 0;                                                      // Relative resolution
+  if (range->resolution_ppb) target = range->resolution_ppb * 1e-9;
+  if (range->resolution_mhz) {
+    double abs_rel = range->resolution_mhz * 1e-3 / frequency;
+    if (target == 0 || abs_rel < target) target = abs_rel;
+  }
+  if (target == 0) return 0;
+
+  double k;                                                               // Resolution * gate, seconds
+  if (method == FM_MODE_RECIPROCAL) k = 1.0 / FM_TIMEBASE_HZ;
+  else k = 0.5 / frequency + (double)FM_HAL_NOW_RES / FM_TIMEBASE_HZ;
+
+  double us = k / target * 1e6;
+  return us >= 4294967295.0 ? 0xFFFFFFFFu : (uint32_t)us + 1;
+}
+
+//----------------------------------------------------------------------------------
+double fm_range_resolution(const fm_result_t *res)
+{
+  if (res->gate_ticks == 0 || res->frequency <= 0) return 0;
+  double k;                                                               // Resolution * gate, seconds, as above
+  if (res->method == FM_MODE_RECIPROCAL) k = 1.0 / FM_TIMEBASE_HZ;
+  else k = 0.5 / res->frequency + (double)FM_HAL_NOW_RES / FM_TIMEBASE_HZ;
+  return k * res->frequency * FM_TIMEBASE_HZ / (double)res->gate_ticks;
+}
+
+//----------------------------------------------------------------------------------
+uint32_t fm_range_select(const fm_range_t *range, uint32_t gate_us, double frequency, fm_mode_t method)
+{
+  uint32_t need = fm_range_needed(range, frequency, method);
+  if (need == 0) return gate_us;                                          // Autorange off or no reading: keep the gate
+
+  uint32_t lo = range->min_gate_us ? range->min_gate_us : FM_RANGE_MIN_GATE_US;
+  uint32_t hi = range->max_gate_us ? range->max_gate_us : FM_RANGE_MAX_GATE_US;
+  if (hi < lo) hi = lo;
+
+  uint32_t wide   = ladder_ceil(need, lo, hi);                            // Just meets the target
+  uint32_t narrow = ladder_ceil(need * 100.0 / FM_RANGE_HYST_PCT, lo, hi); // Meets it with margin
+  if (wide > gate_us) return wide;                                        // Target missed: widen now
+  if (narrow < gate_us) return narrow;                                    // Comfortably met: narrow
+  return gate_us;
+}
@@ -0,0 +1,81 @@
+/* ESP32 Frequency Meter - measurement record ring
+
+   One producer (the gate timer / capture ISR, see publish() in fm_core.c)
+   and any number of readers, each with its own position. The producer never
+   waits: when the ring is full it overwrites the oldest record. A reader that
+   falls behind skips to the oldest record still in the ring and adds the
+   skipped ones to its dropped counter, so a slow consumer loses whole
+   records but never sees a half written one.
+
+   Every slot carries a stamp: 2 * index + 1 while the producer writes it,
+   2 * index + 2 once it is complete. A reader copies the slot and accepts it
+   only if the stamp was the expected one before and after the copy.
+*/
+
+#include "fm_core.h"
+
+#define RING_MASK             (FM_RING_SIZE - 1)
+
+#if (FM_RING_SIZE & RING_MASK) != 0
+#error "FM_RING_SIZE must be a power of two"
+#endif
+
+//----------------------------------------------------------------------------------
+void fm_ring_init(fm_ring_t *ring)
+{
+  ring->head = 0;
+  for (uint32_t i = 0; i < FM_RING_SIZE; i++) ring->slot[i].stamp = 0;
+}
+
+//----------------------------------------------------------------------------------
+void FM_IRAM fm_ring_push(fm_ring_t *ring, const fm_result_t *rec)        // Producer, never blocks
+{
+  uint32_t idx = ring->head;
+  fm_ring_slot_t *s = &ring->slot[idx & RING_MASK];
+
+  __atomic_store_n(&s->stamp, 2 * idx + 1, __ATOMIC_RELAXED);             // Slot busy
+  __atomic_thread_fence(__ATOMIC_RELEASE);                                // ... before any of the record
+  s->rec = *rec;
+  s->rec.seq = idx;
+  __atomic_store_n(&s->stamp, 2 * idx + 2, __ATOMIC_RELEASE);             // Record complete
+  __atomic_store_n(&ring->head, idx + 1, __ATOMIC_RELEASE);
+}
+
+//----------------------------------------------------------------------------------
+void fm_ring_reader_init(const fm_ring_t *ring, fm_reader_t *rd)          // Start with the next record pushed
+{
+  rd->tail = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  rd->dropped = 0;
+}
+
+//----------------------------------------------------------------------------------
+bool fm_ring_read(const fm_ring_t *ring, fm_reader_t *rd, fm_result_t *rec) // Oldest unread record
+{
+  uint32_t lost = 0;
+  for (;;) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == rd->tail) {
+      rd->dropped += lost;
+      return false;                                                       // Nothing new
+    }
+    if (head - rd->tail > FM_RING_SIZE) {                                 // Producer lapped this reader
+      lost += head - rd->tail - FM_RING_SIZE;
+      rd->tail = head - FM_RING_SIZE;
+    }
+
+    const fm_ring_slot_t *s = &ring->slot[rd->tail & RING_MASK];
+    uint32_t want = 2 * rd->tail + 2;
+    if (__atomic_load_n(&s->stamp, __ATOMIC_ACQUIRE) == want) {
+      *rec = s->rec;
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);                            // Copy done before the second stamp read
+      if (__atomic_load_n(&s->stamp, __ATOMIC_RELAXED) == want) {
+        rd->tail++;
+        rd->dropped += lost;
+        rec->overflow = lost != 0;
+        return true;
+      }
+    }
+    lost++;                                                               // Overwritten while reading, skip it
+    rd->tail++;
+  }
+}
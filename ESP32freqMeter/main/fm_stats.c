@@ -0,0 +1,137 @@
+/* ESP32 Frequency Meter - streaming statistics, see fm_stats.h
+
+   Allan deviation from phase: every reading adds its fractional frequency
+   y = (f - ref) / ref times its actual gate length to the phase x, and for
+   each tau = m nominal gates the second difference x[n] - 2 x[n-m] + x[n-2m]
+   is squared and summed: AVAR(tau) = sum / (2 tau^2 terms). Each level
+   keeps the last FM_STATS_HIST phase points, enough for m up to
+   FM_STATS_HIST / 2, and passes the phase of every FM_STATS_DECIM readings
+   on to the next level as one step.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "fm_stats.h"
+
+#define HIST_MASK             (FM_STATS_HIST - 1)
+
+//----------------------------------------------------------------------------------
+static void allan_reset(fm_stats_t *st)
+{
+  memset(st->level, 0, sizeof(st->level));                                // Phase 0 at n = 0 is implied
+  for (int l = 0; l < FM_STATS_LEVELS; l++) st->level[l].n = 1;
+  st->tau0 = 0;
+}
+
+//----------------------------------------------------------------------------------
+void fm_stats_reset(fm_stats_t *st)
+{
+  st->n = 0;
+  st->mean = 0;
+  st->m2 = 0;
+  st->min = 0;
+  st->max = 0;
+  st->t0 = 0;
+  st->mean_t = 0;
+  st->m2_t = 0;
+  st->c_tf = 0;
+  st->ref = 0;
+  allan_reset(st);
+}
+
+//----------------------------------------------------------------------------------
+static void allan_add(fm_stats_t *st, int l, double dx)                   // Phase step over one level sample, seconds
+{
+  fm_stats_level_t *lv = &st->level[l];
+  uint32_t n = lv->n;
+  double x = lv->x[(n - 1) & HIST_MASK] + dx;
+  lv->x[n & HIST_MASK] = x;
+  lv->n = ++n;
+
+  for (int k = l ? 1 : 0; k < FM_STATS_OCTAVES; k++) {                    // Level tau 1 duplicates the last octave below
+    uint32_t m = 1u << k;
+    if (n <= 2 * m) break;
+    double d = x - 2 * lv->x[(n - 1 - m) & HIST_MASK] + lv->x[(n - 1 - 2 * m) & HIST_MASK];
+    lv->sum[k] += d * d;
+    lv->cnt[k]++;
+  }
+
+  if (l + 1 < FM_STATS_LEVELS) {                                          // Decimate into the next level
+    lv->acc += dx;
+    if (++lv->acc_n == FM_STATS_DECIM) {
+      allan_add(st, l + 1, lv->acc);
+      lv->acc = 0;
+      lv->acc_n = 0;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------
+void fm_stats_add(fm_stats_t *st, const fm_result_t *res)
+{
+  double f = res->frequency;
+  double t = (double)res->gate_end / FM_TIMEBASE_HZ;
+  double gate = (double)res->gate_ticks / FM_TIMEBASE_HZ;
+
+  if (st->n == 0) {
+    st->min = f;
+    st->max = f;
+    st->t0 = t;
+  }
+  if (st->ref <= 0) st->ref = f;                                          // First reading with a signal
+  st->n++;
+  if (f < st->min) st->min = f;
+  if (f > st->max) st->max = f;
+
+  double dt = (t - st->t0) - st->mean_t;                                  // Welford, frequency and time together
+  double df = f - st->mean;
+  st->mean += df / st->n;
+  st->mean_t += dt / st->n;
+  st->m2 += df * (f - st->mean);
+  st->m2_t += dt * ((t - st->t0) - st->mean_t);
+  st->c_tf += dt * (f - st->mean);
+
+  if (st->ref <= 0 || gate <= 0) return;                                  // No input: nothing to say about stability
+  double nominal = (double)res->gate_nominal / FM_TIMEBASE_HZ;            // 0 in decoded records: first gate is tau0
+  if (st->tau0 > 0 && nominal > 0 && nominal != st->tau0) allan_reset(st); // Configured gate changed
+  if (st->tau0 == 0) st->tau0 = nominal > 0 ? nominal : gate;
+  allan_add(st, 0, (f - st->ref) / st->ref * gate);                       // Phase over the gate actually counted
+}
+
+//----------------------------------------------------------------------------------
+void fm_stats_report(const fm_stats_t *st, fm_stats_report_t *rep)
+{
+  memset(rep, 0, sizeof(*rep));
+  rep->n = st->n;
+  if (st->n == 0) return;
+  rep->mean = st->mean;
+  rep->stddev = st->n > 1 ? sqrt(st->m2 / (st->n - 1)) : 0;
+  rep->min = st->min;
+  rep->max = st->max;
+  rep->drift = st->m2_t > 0 ? st->c_tf / st->m2_t : 0;
+
+  double tau_l = st->tau0;
+  for (int l = 0; l < FM_STATS_LEVELS; l++, tau_l *= FM_STATS_DECIM) {
+    const fm_stats_level_t *lv = &st->level[l];
+    for (int k = l ? 1 : 0; k < FM_STATS_OCTAVES; k++) {
+      if (lv->cnt[k] == 0) continue;
+      double tau = tau_l * (1u << k);
+      rep->tau[rep->taus] = tau;
+      rep->adev[rep->taus] = sqrt(lv->sum[k] / (2.0 * tau * tau * lv->cnt[k]));
+      rep->terms[rep->taus] = lv->cnt[k];
+      rep->taus++;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------------
+int fm_stats_format(const fm_stats_report_t *rep, char *buf, int size)
+{
+  int len = snprintf(buf, size, "n %llu  mean %.6f Hz  sd %.6g Hz  min %.6f  max %.6f  drift %.4g Hz/s\n",
+                     (unsigned long long)rep->n, rep->mean, rep->stddev, rep->min, rep->max, rep->drift);
+  for (int i = 0; i < rep->taus && len < size; i++)
+    len += snprintf(buf + len, size - len, "tau %10.4f s  adev %.3e  (%u)\n", rep->tau[i], rep->adev[i],
+                    rep->terms[i]);
+  return len < size ? len : size - 1;
+}
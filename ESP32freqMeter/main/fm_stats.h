@@ -0,0 +1,83 @@
+/* ESP32 Frequency Meter - streaming statistics
+
+   Fed with every finished gate of one channel, constant work and memory per
+   reading:
+     mean, standard deviation    Welford's update, no sum of squares
+     min, max
+     drift                       least squares slope of frequency over time, Hz/s
+     overlapping Allan deviation at tau = 1, 2, 4 ... 64 gates, then the same
+                                 octaves on readings averaged over 64, 64^2
+                                 and 64^3 gates (FM_STATS_LEVELS levels)
+
+   The Allan deviation needs back to back gates of one configured length
+   (continuous, reciprocal or auto mode). A reading whose nominal gate
+   differs from the first one (autorange step, GATe command) restarts it;
+   the other figures keep going. Reciprocal gates end on an input edge and
+   vary around the nominal length, which only sets tau. Past 64 gates the
+   points overlap by whole 64 gate blocks only, so they rest on fewer terms
+   than a full overlapping estimate.
+*/
+
+#ifndef FM_STATS_H
+#define FM_STATS_H
+
+#include <stdint.h>
+#include "fm_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FM_STATS_HIST         256                                         // Phase history per level, power of two > 2 * 64
+#define FM_STATS_OCTAVES      7                                           // tau = 1 .. 64 samples per level
+#define FM_STATS_DECIM        (1 << (FM_STATS_OCTAVES - 1))               // Samples averaged into one of the next level
+#define FM_STATS_LEVELS       4                                           // tau up to 64^4 gates
+#define FM_STATS_TAUS         (FM_STATS_OCTAVES * FM_STATS_LEVELS)
+
+typedef struct {
+  double   x[FM_STATS_HIST];                                              // Phase ring, seconds
+  uint32_t n;                                                             // Phase points written
+  double   sum[FM_STATS_OCTAVES];                                         // Sum of second differences squared
+  uint32_t cnt[FM_STATS_OCTAVES];                                         // Terms in sum
+  double   acc;                                                           // Phase step for the next level, seconds
+  uint32_t acc_n;
+} fm_stats_level_t;
+
+typedef struct {
+  uint64_t n;                                                             // Readings
+  double   mean;                                                          // Hz
+  double   m2;                                                            // Sum of squared deviations
+  double   min;
+  double   max;
+  double   t0;                                                            // First gate end, seconds
+  double   mean_t;                                                        // Mean time, seconds from t0
+  double   m2_t;
+  double   c_tf;                                                          // Time / frequency co-moment
+  double   ref;                                                           // Fractional frequency reference, Hz
+  double   tau0;                                                          // Nominal gate of the Allan data, seconds
+  fm_stats_level_t level[FM_STATS_LEVELS];
+} fm_stats_t;
+
+typedef struct {
+  uint64_t n;
+  double   mean;                                                          // Hz
+  double   stddev;                                                        // Hz, sample standard deviation
+  double   min;                                                           // Hz
+  double   max;                                                           // Hz
+  double   drift;                                                         // Hz per second
+  int      taus;                                                          // Allan points with data
+  double   tau[FM_STATS_TAUS];                                            // Seconds
+  double   adev[FM_STATS_TAUS];                                           // Overlapping Allan deviation, fractional
+  uint32_t terms[FM_STATS_TAUS];                                          // Terms behind each point
+} fm_stats_report_t;
+
+void     fm_stats_reset(fm_stats_t *st);
+void     fm_stats_add(fm_stats_t *st, const fm_result_t *res);            // One finished gate
+void     fm_stats_report(const fm_stats_t *st, fm_stats_report_t *rep);   // Current figures, any time
+int      fm_stats_format(const fm_stats_report_t *rep, char *buf, int size); // Console text, returns length
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FM_STATS_H
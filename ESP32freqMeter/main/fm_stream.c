@@ -0,0 +1,141 @@
+/* ESP32 Frequency Meter - binary record stream, see fm_stream.h
+
+   Encoding is a handful of stores per reading, no division and no number
+   formatting: the receiver computes the frequency from the raw fields.
+*/
+
+#include <string.h>
+#include "fm_stream.h"
+
+static const uint16_t crc_nibble[16] = {                                  // CRC-16/CCITT-FALSE, 4 bits per step
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+//----------------------------------------------------------------------------------
+static void put16(uint8_t *p, uint16_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void put64(uint8_t *p, uint64_t v)
+{
+  put32(p, (uint32_t)v);
+  put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+  return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+  return get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+//----------------------------------------------------------------------------------
+uint16_t fm_stream_crc(const uint8_t *data, size_t len)
+{
+  uint16_t crc = 0xFFFF;
+  while (len--) {
+    crc = (uint16_t)(crc << 4) ^ crc_nibble[(crc >> 12) ^ (*data >> 4)];
+    crc = (uint16_t)(crc << 4) ^ crc_nibble[(crc >> 12) ^ (*data & 0x0F)];
+    data++;
+  }
+  return crc;
+}
+
+//----------------------------------------------------------------------------------
+void fm_stream_init(fm_stream_t *st)
+{
+  st->count = 0;
+  st->base = 0;
+}
+
+//----------------------------------------------------------------------------------
+bool fm_stream_add(fm_stream_t *st, const fm_result_t *res)
+{
+  uint8_t *f = st->frame;
+  if (st->count == 0) {                                                   // New frame
+    f[0] = FM_STREAM_SYNC0;
+    f[1] = FM_STREAM_SYNC1;
+    f[2] = FM_STREAM_VERSION;
+    put32(f + 4, res->seq);
+    put64(f + 8, res->gate_end);
+    st->base = res->gate_end;
+  }
+
+  uint8_t status = (uint8_t)(res->method & FM_STREAM_METHOD);
+  if (res->overflow) status |= FM_STREAM_DROPPED;
+  uint64_t end = res->gate_end - st->base;
+  if (end > UINT32_MAX || res->edges > UINT32_MAX || res->gate_ticks > UINT32_MAX) status |= FM_STREAM_CLIPPED;
+
+  uint8_t *r = f + FM_STREAM_HEADER + st->count * FM_STREAM_RECORD;
+  put16(r, (uint16_t)res->seq);
+  r[2] = res->channel;
+  r[3] = status;
+  put32(r + 4, end > UINT32_MAX ? UINT32_MAX : (uint32_t)end);
+  put32(r + 8, res->edges > UINT32_MAX ? UINT32_MAX : (uint32_t)res->edges);
+  put32(r + 12, res->gate_ticks > UINT32_MAX ? UINT32_MAX : (uint32_t)res->gate_ticks);
+  st->count++;
+  return st->count >= FM_STREAM_BATCH;
+}
+
+//----------------------------------------------------------------------------------
+size_t fm_stream_finish(fm_stream_t *st)
+{
+  if (st->count == 0) return 0;
+  size_t len = FM_STREAM_HEADER + st->count * FM_STREAM_RECORD;
+  st->frame[3] = st->count;
+  put16(st->frame + len, fm_stream_crc(st->frame + 2, len - 2));
+  st->count = 0;                                                          // Next fm_stream_add opens a new frame
+  return len + 2;
+}
+
+//----------------------------------------------------------------------------------
+size_t fm_stream_frame_len(const uint8_t *hdr)
+{
+  if (hdr[0] != FM_STREAM_SYNC0 || hdr[1] != FM_STREAM_SYNC1) return 0;
+  if (hdr[2] != FM_STREAM_VERSION || hdr[3] == 0 || hdr[3] > FM_STREAM_BATCH) return 0;
+  return FM_STREAM_HEADER + (size_t)hdr[3] * FM_STREAM_RECORD + 2;
+}
+
+//----------------------------------------------------------------------------------
+int fm_stream_decode(const uint8_t *frame, size_t len, fm_result_t *res, uint8_t *status, int max)
+{
+  if (len < 4 || fm_stream_frame_len(frame) != len) return -1;
+  if (fm_stream_crc(frame + 2, len - 4) != get16(frame + len - 2)) return -1;
+
+  int count = frame[3] < max ? frame[3] : max;
+  uint32_t seq = get32(frame + 4);
+  uint64_t base = get64(frame + 8);
+  for (int i = 0; i < count; i++) {
+    const uint8_t *r = frame + FM_STREAM_HEADER + i * FM_STREAM_RECORD;
+    fm_result_t *o = &res[i];
+    memset(o, 0, sizeof(*o));
+    o->seq        = seq + (uint16_t)(get16(r) - (uint16_t)seq);           // Full number from the frame's first
+    o->channel    = r[2];
+    o->method     = (fm_mode_t)(r[3] & FM_STREAM_METHOD);
+    o->overflow   = (r[3] & FM_STREAM_DROPPED) != 0;
+    o->gate_end   = base + get32(r + 4);
+    o->edges      = get32(r + 8);
+    o->gate_ticks = get32(r + 12);
+    o->gate_start = o->gate_end - o->gate_ticks;
+    o->frequency  = fm_frequency(o->edges, o->gate_ticks);
+    if (status) status[i] = r[3];                                         // Raw status, with FM_STREAM_CLIPPED
+  }
+  return count;
+}
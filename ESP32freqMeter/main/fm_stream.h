@@ -0,0 +1,64 @@
+/* ESP32 Frequency Meter - binary record stream
+
+   Framed batches of fixed size records for logging at high reading rates.
+   All fields little endian.
+
+   Frame:  sync   2  0xA5 0x5A
+           ver    1  FM_STREAM_VERSION
+           count  1  records in the frame, 1..FM_STREAM_BATCH
+           seq    4  sequence number of the first record
+           base   8  timestamp the record offsets count from, ticks
+           record count * FM_STREAM_RECORD
+           crc    2  CRC-16/CCITT-FALSE of ver..last record
+
+   Record: seq    2  low 16 bits of the sequence number
+           chan   1  channel
+           status 1  bits 0-1 method, FM_STREAM_DROPPED, FM_STREAM_CLIPPED
+           end    4  gate end - base, ticks
+           edges  4  edges counted in the gate
+           ticks  4  gate length, ticks
+
+   frequency = edges * FM_TIMEBASE_HZ / (2 * ticks), as fm_frequency().
+*/
+
+#ifndef FM_STREAM_H
+#define FM_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fm_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FM_STREAM_VERSION     1
+#define FM_STREAM_SYNC0       0xA5
+#define FM_STREAM_SYNC1       0x5A
+#define FM_STREAM_BATCH       16                                          // Records per frame, at most
+#define FM_STREAM_HEADER      16                                          // Bytes before the first record
+#define FM_STREAM_RECORD      16                                          // Bytes per record
+#define FM_STREAM_FRAME_MAX   (FM_STREAM_HEADER + FM_STREAM_BATCH * FM_STREAM_RECORD + 2)
+
+#define FM_STREAM_METHOD      0x03                                        // Status: fm_mode_t of the reading
+#define FM_STREAM_DROPPED     0x04                                        // Status: records lost before this one
+#define FM_STREAM_CLIPPED     0x08                                        // Status: a field did not fit 32 bits
+
+typedef struct {
+  uint8_t  frame[FM_STREAM_FRAME_MAX];
+  uint8_t  count;                                                         // Records in the open frame
+  uint64_t base;                                                          // Timestamp of the first record
+} fm_stream_t;
+
+void     fm_stream_init(fm_stream_t *st);
+bool     fm_stream_add(fm_stream_t *st, const fm_result_t *res);          // Append a reading, true when the frame is full
+size_t   fm_stream_finish(fm_stream_t *st);                               // Seal the frame, returns its length (0 = empty)
+size_t   fm_stream_frame_len(const uint8_t *hdr);                         // Length from the first 4 bytes, 0 = not a header
+int      fm_stream_decode(const uint8_t *frame, size_t len, fm_result_t *res, uint8_t *status, int max); // Records, -1 = bad frame
+uint16_t fm_stream_crc(const uint8_t *data, size_t len);                  // CRC-16/CCITT-FALSE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FM_STREAM_H
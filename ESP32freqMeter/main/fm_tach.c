@@ -0,0 +1,128 @@
+/* ESP32 Frequency Meter - quadrature encoder / tachometer, see fm_tach.h
+
+   Position = limit events * FM_TACH_LIM + counter, with the limit events
+   signed by the limit reached. The counter is read under the lock together
+   with the pending event bit, as in the meter's snapshot: an event that has
+   reset the counter but not reached the ISR yet is added here.
+
+   An edge set is kept only if it spans one A period at the counted speed:
+   a capture register overwritten before the ISR read it (an A half period
+   shorter than the interrupt latency) joins edges of different periods.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include "fm_tach.h"
+
+static fm_tach_config_t  cfg;                                             // Active configuration
+static volatile int32_t  tachMult    = 0;                                 // Limit events, + high, - low (ISR)
+static int64_t           lastPos     = 0;                                 // Position at the previous read
+static uint64_t          lastTime    = 0;
+static uint64_t          prevTime    = 0;                                 // Time of the read before that
+
+static volatile bool     edgesNew    = false;                             // Edge set waiting for fm_tach_read
+static uint64_t          edgeSet[4];                                      // A rise, A fall, B rise, next A rise
+static bool              edgesValid  = false;                             // duty, phase, periodRps measured
+static double            duty        = 0;
+static double            phase       = 0;
+static double            periodRps   = 0;
+static uint64_t          periodTicks = 0;                                 // A period of the set
+static uint64_t          periodEnd   = 0;                                 // Last A rise of the set
+
+//----------------------------------------------------------------------------------
+static void FM_IRAM tach_isr(uint32_t status, void *arg)                  // Counter reached a limit and reset to 0
+{
+  (void)status;
+  (void)arg;
+  tachMult += fm_hal_pcnt_limit_dir(cfg.unit);
+}
+
+//----------------------------------------------------------------------------------
+static void FM_IRAM edges_isr(const uint64_t *edge, void *arg)            // Edge set complete
+{
+  (void)arg;
+  for (int i = 0; i < 4; i++) edgeSet[i] = edge[i];
+  edgesNew = true;
+}
+
+//----------------------------------------------------------------------------------
+static int64_t position(uint64_t *t)                                      // Counter + limit events, 64 bits
+{
+  fm_hal_lock();                                                          // ISRs cannot run between the reads
+  int16_t count = fm_hal_pcnt_get(cfg.unit);
+  uint32_t pending = fm_hal_pcnt_overflow_pending() & (1u << cfg.unit);
+  *t = fm_hal_now();
+  int32_t mult = tachMult;
+  if (pending && abs(count) < FM_TACH_LIM / 2) mult += fm_hal_pcnt_limit_dir(cfg.unit); // Reset, ISR not run yet
+  fm_hal_unlock();
+  return (int64_t)mult * FM_TACH_LIM + count;
+}
+
+//----------------------------------------------------------------------------------
+void fm_tach_init(const fm_tach_config_t *config)
+{
+  cfg = *config;
+  if (cfg.ppr == 0) cfg.ppr = 1;
+  tachMult = 0;
+  edgesNew = false;
+  edgesValid = false;
+
+  fm_hal_init();                                                          // Timebase, kept if the meter started it
+  fm_hal_pcnt_quad_init(cfg.unit, cfg.a_gpio, cfg.b_gpio, FM_TACH_LIM);   // x4 decode in the Pulse Counter
+  fm_hal_pcnt_isr_register(1u << cfg.unit, tach_isr, NULL);               // One interrupt per FM_TACH_LIM counts
+  fm_hal_edges_init(cfg.a_gpio, cfg.b_gpio, edges_isr, NULL);             // Duty and phase timestamps
+  lastPos = position(&lastTime);
+  prevTime = lastTime;
+  fm_hal_edges_arm();
+}
+
+//----------------------------------------------------------------------------------
+void fm_tach_read(fm_tach_result_t *res)
+{
+  uint64_t t;
+  int64_t pos = position(&t);
+  int64_t d = pos - lastPos;
+
+  res->position  = pos;
+  res->direction = d > 0 ? 1 : d < 0 ? -1 : 0;
+  res->time      = t;
+  res->window    = t - lastTime;
+  res->rps       = res->window ? (double)d * FM_TIMEBASE_HZ / res->window / (4.0 * cfg.ppr) : 0;
+
+  if (edgesNew) {                                                         // New edge set: take it, ask for the next
+    uint64_t e[4];
+    fm_hal_lock();
+    for (int i = 0; i < 4; i++) e[i] = edgeSet[i];
+    edgesNew = false;
+    fm_hal_unlock();
+    double period = (double)(e[3] - e[0]);
+    double cycles = (double)llabs(d) / 4.0 * period / res->window;        // A periods the set spans at the counted speed
+    edgesValid = e[1] > e[0] && e[1] < e[3] && e[2] > e[0] && e[2] < e[3] &&
+                 (llabs(d) < 8 || (cycles > 0.5 && cycles < 1.5));        // An edge overwritten before the ISR read it
+    if (edgesValid) {
+      duty        = (e[1] - e[0]) / period;
+      phase       = (e[2] - e[0]) / period * 360.0;
+      periodRps   = FM_TIMEBASE_HZ / period / cfg.ppr;
+      periodTicks = e[3] - e[0];
+      periodEnd   = e[3];
+    }
+    fm_hal_edges_arm();
+  }
+
+  res->from_period = false;                                               // 1 tick in the period beats 1 count in the window
+  double expect = periodRps * 4.0 * cfg.ppr * res->window / FM_TIMEBASE_HZ; // Counts in the window at the period's speed
+  if (d != 0 && edgesValid && periodEnd > prevTime && periodTicks > (uint64_t)llabs(d) &&
+      fabs(expect - (double)llabs(d)) < 2.0) {                            // Same speed within the count's resolution
+    res->rps = res->direction * periodRps;
+    res->from_period = true;
+  }
+  res->rpm         = res->rps * 60.0;
+  res->edges_valid = edgesValid;
+  res->duty        = duty;
+  res->phase       = phase;
+  res->period_rps  = periodRps;
+
+  lastPos  = pos;
+  prevTime = lastTime;
+  lastTime = t;
+}
@@ -0,0 +1,66 @@
+/* ESP32 Frequency Meter - quadrature encoder / tachometer
+
+   One PCNT unit decodes an encoder A / B pair in hardware (x4: every edge of
+   both inputs counts, up or down with the direction), so the shaft costs no
+   interrupt per edge: the unit interrupts once per FM_TACH_LIM counts, in
+   either direction, to extend the count to 64 bits.
+
+   fm_tach_read() gives the position, and the speed and direction over the
+   time since the previous read. Duty cycle of A and the B phase come from one
+   set of edge timestamps (MCPWM capture 1 and 2) taken after each read. Its
+   A period, resolved to one tick, replaces the count as the speed when it
+   resolves better (period ticks > counts in the read), was measured during
+   this read or the one before, and agrees with the count to 2 counts.
+
+   The edge timestamps come from capture registers that every edge
+   overwrites, so each A half period must outlast the capture interrupt
+   latency (about 1 us, more when other interrupts run first): duty and
+   phase are measured up to about 250 kHz on A at 50 % duty. Faster, the
+   edge sets are dropped and edges_valid is false; position and speed from
+   the count are not affected.
+
+   Runs next to the frequency meter on a unit the meter does not use.
+*/
+
+#ifndef FM_TACH_H
+#define FM_TACH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fm_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FM_TACH_LIM           20000                                       // Counter limit, both directions
+
+typedef struct {
+  int      unit;                                                          // PCNT unit
+  int      a_gpio;                                                        // Encoder A
+  int      b_gpio;                                                        // Encoder B
+  uint32_t ppr;                                                           // A periods per revolution
+} fm_tach_config_t;
+
+typedef struct {
+  int64_t  position;                                                      // Counts since fm_tach_init, 4 per A period
+  int      direction;                                                     // 1 forwards (A leads B), -1 backwards, 0 stopped
+  double   rps;                                                           // Revolutions per second, signed
+  double   rpm;                                                           // Revolutions per minute, signed
+  bool     from_period;                                                   // Speed from the last A period, not the count
+  uint64_t time;                                                          // Position timestamp, ticks
+  uint64_t window;                                                        // Ticks since the previous read
+  bool     edges_valid;                                                   // duty / phase below are measured
+  double   duty;                                                          // A high share, 0..1
+  double   phase;                                                         // B rise after A rise, degrees: 90 forwards, 270 backwards
+  double   period_rps;                                                    // Speed from the A period, unsigned
+} fm_tach_result_t;
+
+void     fm_tach_init(const fm_tach_config_t *cfg);                       // Configure the unit and the edge capture
+void     fm_tach_read(fm_tach_result_t *res);                             // Position now, speed since the last read
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FM_TACH_H
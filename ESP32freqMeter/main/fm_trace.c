@@ -0,0 +1,152 @@
+/* ESP32 Frequency Meter - hot path instrumentation, see fm_trace.h
+
+   Histograms keep raw ticks, cycles or counts; the conversion to ns and the
+   percentiles (upper bound of the bucket reaching the share) are done by
+   fm_trace_format only.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "fm_trace.h"
+
+#if FM_TRACE
+
+enum { UNIT_TICKS, UNIT_CYCLES, UNIT_COUNT };
+
+static const struct {
+  const char *name;
+  uint8_t     unit;
+} histInfo[FM_TRACE_HISTS] = {
+  { "gate_late",   UNIT_TICKS  },
+  { "gate_jitter", UNIT_TICKS  },
+  { "capture_lat", UNIT_TICKS  },
+  { "result_lat",  UNIT_TICKS  },
+  { "pcnt_isr",    UNIT_CYCLES },
+  { "capture_isr", UNIT_CYCLES },
+  { "gate_cb",     UNIT_CYCLES },
+  { "loop",        UNIT_CYCLES },
+  { "ovf_gate",    UNIT_COUNT  },
+};
+
+static const char *counterName[FM_TRACE_COUNTERS] = {
+  "gates", "late_gates", "pcnt_irqs", "captures", "ring_drops", "cmd_waits"
+};
+
+static fm_trace_t        trace;
+static uint32_t          lastLate    = 0;                                 // gate_late of the previous gate
+static uint32_t          loopLast    = 0;                                 // Cycle counter at the last loop pass
+static bool              loopSeen    = false;
+
+//----------------------------------------------------------------------------------
+void FM_IRAM fm_trace_hist(int id, uint32_t v)
+{
+  fm_trace_hist_t *h = &trace.hist[id];
+  int b = v ? 32 - __builtin_clz(v) : 0;                                  // Bits of v: v < 2^b
+  if (b >= FM_TRACE_BUCKETS) b = FM_TRACE_BUCKETS - 1;
+  h->bucket[b]++;
+  if (h->n == 0 || v < h->min) h->min = v;
+  if (v > h->max) h->max = v;
+  h->sum += v;
+  h->n++;
+}
+
+//----------------------------------------------------------------------------------
+void FM_IRAM fm_trace_count(int id, uint32_t n)
+{
+  trace.counter[id] += n;
+}
+
+//----------------------------------------------------------------------------------
+void FM_IRAM fm_trace_gate(uint64_t due, uint64_t closed)
+{
+  uint64_t d = closed > due ? closed - due : 0;
+  uint32_t late = d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+  if (trace.counter[FM_TRACE_GATES]++)
+    fm_trace_hist(FM_TRACE_GATE_JITTER, late > lastLate ? late - lastLate : lastLate - late);
+  fm_trace_hist(FM_TRACE_GATE_LATE, late);
+  if (late > (uint64_t)FM_TRACE_LATE_US * (FM_TIMEBASE_HZ / 1000000)) trace.counter[FM_TRACE_LATE_GATES]++;
+  lastLate = late;
+}
+
+//----------------------------------------------------------------------------------
+void fm_trace_loop(void)
+{
+  uint32_t now = fm_hal_cycles();
+  if (loopSeen) fm_trace_hist(FM_TRACE_LOOP, now - loopLast);
+  loopLast = now;
+  loopSeen = true;
+}
+
+//----------------------------------------------------------------------------------
+void fm_trace_reset(void)
+{
+  memset(&trace, 0, sizeof(trace));
+  loopSeen = false;
+}
+
+//----------------------------------------------------------------------------------
+void fm_trace_get(fm_trace_t *snap)
+{
+  *snap = trace;
+}
+
+//----------------------------------------------------------------------------------
+static double to_ns(int unit, double v)
+{
+  if (unit == UNIT_TICKS) return v * 1e9 / FM_TIMEBASE_HZ;
+  if (unit == UNIT_CYCLES) return v * 1e9 / FM_HAL_CYCLES_HZ;
+  return v;
+}
+
+//----------------------------------------------------------------------------------
+static double percentile(const fm_trace_hist_t *h, int unit, uint32_t permille) // Upper bound of the bucket reaching it
+{
+  uint64_t need = ((uint64_t)h->n * permille + 999) / 1000, seen = 0;
+  for (int b = 0; b < FM_TRACE_BUCKETS; b++) {
+    seen += h->bucket[b];
+    if (seen >= need) return to_ns(unit, b ? (double)(1ULL << b) : 1);
+  }
+  return to_ns(unit, h->max);
+}
+
+//----------------------------------------------------------------------------------
+int fm_trace_format(char *buf, int size, char sep)
+{
+  fm_trace_t t = trace;                                                   // Snapshot, see fm_trace.h
+  int len = 0;
+  buf[0] = 0;
+  for (int i = 0; i < FM_TRACE_HISTS && len < size; i++) {
+    const fm_trace_hist_t *h = &t.hist[i];
+    int u = histInfo[i].unit;
+    if (h->n == 0) continue;
+    len += snprintf(buf + len, size - len, "%s %s n=%u min=%.0f mean=%.0f max=%.0f p50<%.0f p99<%.0f |",
+                    histInfo[i].name, u == UNIT_COUNT ? "count" : "ns", h->n, to_ns(u, h->min),
+                    to_ns(u, (double)h->sum / h->n), to_ns(u, h->max), percentile(h, u, 500), percentile(h, u, 990));
+    for (int b = 0; b < FM_TRACE_BUCKETS && len < size; b++)
+      if (h->bucket[b])
+        len += snprintf(buf + len, size - len, " <%.0f:%u", to_ns(u, b ? (double)(1ULL << b) : 1), h->bucket[b]);
+    if (len < size) len += snprintf(buf + len, size - len, "%c", sep);
+  }
+  if (len < size) len += snprintf(buf + len, size - len, "counters");
+  for (int i = 0; i < FM_TRACE_COUNTERS && len < size; i++)
+    len += snprintf(buf + len, size - len, " %s=%u", counterName[i], t.counter[i]);
+  return len < size ? len : size - 1;
+}
+
+#else
+
+void fm_trace_reset(void) { }
+
+void fm_trace_get(fm_trace_t *snap)
+{
+  memset(snap, 0, sizeof(*snap));
+}
+
+int fm_trace_format(char *buf, int size, char sep)
+{
+  (void)sep;
+  int len = snprintf(buf, size, "trace off");
+  return len < size ? len : size - 1;
+}
+
+#endif
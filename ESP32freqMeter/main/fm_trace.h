@@ -0,0 +1,109 @@
+/* ESP32 Frequency Meter - hot path instrumentation
+
+   Timing of the measurement path, kept on the board in fixed memory:
+     gate_late     gate timer callback after the requested gate end (esp-timer dispatch),
+                   or hardware gate interrupt after the gate end
+     gate_jitter   change of gate_late from one gate to the next
+     capture_lat   input edge to capture ISR entry (reciprocal gates)
+     result_lat    gate end to reading handed to the meter loop
+     pcnt_isr      PCNT ISR entry to exit, critical section included
+     capture_isr   reciprocal gate work in the capture ISR
+     gate_cb       gate timer callback or hardware gate interrupt, entry to exit
+     loop          meter loop pass (fm_trace_loop)
+     ovf_gate      PCNT overflows per reading
+   as log2 histograms with count, min, mean and max, plus counters: gates,
+   late gates (more than FM_TRACE_LATE_US after their end), PCNT interrupts,
+   captures, readings dropped from the record ring and waits on a full command
+   queue. Latencies against a known time are in timebase ticks, spans inside
+   one function in CPU cycles (FM_HAL_CYCLES_HZ; on the host, host time).
+
+   Each histogram and counter has a single writer (one ISR, the gate
+   callback or the loop), so recording takes no lock: a log2, an increment
+   and a compare or two. A dump taken while they run may be one event off.
+
+   FM_TRACE 0 removes every hook at compile time; the dump then reads
+   "trace off".
+*/
+
+#ifndef FM_TRACE_H
+#define FM_TRACE_H
+
+#include <stdint.h>
+#include "fm_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef FM_TRACE
+#define FM_TRACE              1                                           // 0 = no instrumentation code at all
+#endif
+
+#define FM_TRACE_BUCKETS      32                                          // Bucket b: values below 2^b
+#define FM_TRACE_LATE_US      100                                         // Gate closed later than this counts as late
+
+typedef enum {
+  FM_TRACE_GATE_LATE = 0,                                                 // ticks
+  FM_TRACE_GATE_JITTER,                                                   // ticks
+  FM_TRACE_CAPTURE_LAT,                                                   // ticks
+  FM_TRACE_RESULT_LAT,                                                    // ticks
+  FM_TRACE_PCNT_ISR,                                                      // cycles
+  FM_TRACE_CAPTURE_ISR,                                                   // cycles
+  FM_TRACE_GATE_CB,                                                       // cycles
+  FM_TRACE_LOOP,                                                          // cycles
+  FM_TRACE_OVF_GATE,                                                      // count
+  FM_TRACE_HISTS
+} fm_trace_hist_id_t;
+
+typedef enum {
+  FM_TRACE_GATES = 0,
+  FM_TRACE_LATE_GATES,
+  FM_TRACE_PCNT_IRQS,
+  FM_TRACE_CAPTURES,
+  FM_TRACE_RING_DROPS,
+  FM_TRACE_CMD_WAITS,
+  FM_TRACE_COUNTERS
+} fm_trace_counter_id_t;
+
+typedef struct {
+  uint32_t n;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t bucket[FM_TRACE_BUCKETS];
+} fm_trace_hist_t;
+
+typedef struct {
+  fm_trace_hist_t hist[FM_TRACE_HISTS];
+  uint32_t counter[FM_TRACE_COUNTERS];
+} fm_trace_t;
+
+#if FM_TRACE
+#define FM_TRACE_STAMP()      fm_hal_cycles()                             // Start of a span
+#define FM_TRACE_SPAN(id, t0) fm_trace_hist((id), fm_hal_cycles() - (t0)) // Cycles since FM_TRACE_STAMP
+#define FM_TRACE_HIST(id, v)  fm_trace_hist((id), (v))                    // v is not evaluated with FM_TRACE 0
+#define FM_TRACE_COUNT(id, n) fm_trace_count((id), (n))
+#define FM_TRACE_GATE(due, t) fm_trace_gate((due), (t))
+#define FM_TRACE_LOOP()       fm_trace_loop()
+#else
+#define FM_TRACE_STAMP()      0u
+#define FM_TRACE_SPAN(id, t0) ((void)(t0))
+#define FM_TRACE_HIST(id, v)  ((void)sizeof(v))
+#define FM_TRACE_COUNT(id, n) ((void)sizeof(n))
+#define FM_TRACE_GATE(due, t) ((void)sizeof((due) + (t)))
+#define FM_TRACE_LOOP()       ((void)0)
+#endif
+
+void     fm_trace_hist(int id, uint32_t v);                               // One value into a histogram
+void     fm_trace_count(int id, uint32_t n);
+void     fm_trace_gate(uint64_t due, uint64_t closed);                    // Gate closed: gate_late, gate_jitter, counters
+void     fm_trace_loop(void);                                             // Top of every meter loop pass
+void     fm_trace_reset(void);
+void     fm_trace_get(fm_trace_t *snap);                                  // Copy of the figures so far
+int      fm_trace_format(char *buf, int size, char sep);                  // One entry per histogram, sep between, returns length
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FM_TRACE_H